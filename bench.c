@@ -0,0 +1,535 @@
+// SPDX-License-Identifier: MIT
+//
+// Parse throughput of micro-flag.h against the size of the flag table
+// and of argv, compared with glibc getopt_long. Results are printed
+// as CSV on stdout, one row per strategy and configuration:
+//
+//   make bench && ./bench > results.csv
+//   ./bench --flags=16,1024 --argc=100 --types=int,str --perf
+//
+// Each list option takes comma separated values. The strategies are
+// "hash" (micro_flag_compile), "trie" (micro_flag_compile_trie),
+// "simd" (micro_flag_compile_simd) and "getopt" (getopt_long). With
+// --perf, cycles, branch misses and cache misses per argument are
+// read with perf_event_open on Linux; the columns stay empty if the
+// counters cannot be opened.
+
+#define _GNU_SOURCE
+#define MICRO_FLAG_IMPLEMENTATION
+#include "micro-flag.h"
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+typedef enum {
+  BENCH_HASH = 0,
+  BENCH_TRIE,
+  BENCH_SIMD,
+  BENCH_GETOPT,
+  _BENCH_MAX,
+} BenchStrategy;
+
+static const char *bench_strategy_str[] = {
+  "hash", "trie", "simd", "getopt",
+};
+
+// Type mixes of the flag table
+static const char *bench_types_str[] = {
+  "bool", "int", "str", "mixed",
+};
+
+// Long names of the flag table: "--f12" or "--option-000012-long-name"
+static const char *bench_names_str[] = {
+  "short", "long",
+};
+
+typedef struct {
+  bool show_help;
+  char *flags;
+  char *argc;
+  char *types;
+  char *names;
+  char *strategies;
+  double min_time;
+  bool perf;
+  double getopt_limit;
+} Args;
+
+// A flag table with its argument vector
+typedef struct {
+  unsigned int num_flags;
+  MicroFlag *flags;
+  char **names;
+  struct option *options;
+  // Result of a parse, one 8 byte slot per flag
+  uint64_t *values;
+  int argc;
+  char **argv;
+} Bench;
+
+// Hardware counters of one measure, see bench_perf_open
+typedef struct {
+  int fd;
+  uint64_t cycles;
+  uint64_t branch_misses;
+  uint64_t cache_misses;
+} BenchPerf;
+
+static uint64_t bench_random(uint64_t *state)
+{
+  // xorshift64, so that every run parses the same arguments
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Find [value] in the [count] [strs]
+//
+// Returns: its index, or -1 if not found
+static int bench_find(const char **strs, int count, const char *value)
+{
+  for (int i = 0; i < count; ++i)
+    if (strcmp(strs[i], value) == 0)
+      return i;
+  return -1;
+}
+
+static MicroFlagType bench_type(int types, unsigned int i)
+{
+  static const MicroFlagType types_of[] = {
+    MICRO_FLAG_BOOL, MICRO_FLAG_INT, MICRO_FLAG_STR, MICRO_FLAG_DOUBLE,
+  };
+  if (types == 3)
+    return types_of[i % 4];
+  return types_of[types];
+}
+
+// Build a table of [num_flags] flags of [types] with [names], and an
+// argv of [argc] arguments naming random flags
+//
+// Returns: true on success
+static bool bench_init(Bench *b, unsigned int num_flags, int argc,
+                       int types, int names)
+{
+  memset(b, 0, sizeof(*b));
+  b->num_flags = num_flags;
+  b->flags   = calloc(num_flags, sizeof(MicroFlag));
+  b->names   = calloc(num_flags, sizeof(char*));
+  b->options = calloc(num_flags + 1, sizeof(struct option));
+  b->values  = calloc(num_flags, sizeof(uint64_t));
+  b->argc    = argc;
+  b->argv    = calloc(argc + 1, sizeof(char*));
+  if (!b->flags || !b->names || !b->options || !b->values || !b->argv)
+    return false;
+
+  for (unsigned int i = 0; i < num_flags; ++i)
+  {
+    char name[64];
+    if (names == 0)
+      snprintf(name, sizeof(name), "--f%u", i);
+    else
+      snprintf(name, sizeof(name), "--option-%06u-long-name", i);
+    b->names[i] = strdup(name);
+    if (b->names[i] == NULL)
+      return false;
+
+    MicroFlag *f = &b->flags[i];
+    f->type        = bench_type(types, i);
+    f->value       = (void*) (i * sizeof(uint64_t));
+    f->short_name  = NULL;
+    f->long_name   = b->names[i];
+    f->description = "";
+
+    b->options[i].name    = b->names[i] + 2;
+    b->options[i].has_arg = f->type == MICRO_FLAG_BOOL
+      ? no_argument : required_argument;
+    b->options[i].flag    = NULL;
+    b->options[i].val     = (int) i;
+  }
+
+  // Flags and their values each count as one argument
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+  b->argv[0] = "bench";
+  for (int i = 1; i < argc; ++i)
+  {
+    unsigned int flag = (unsigned int) (bench_random(&state) % num_flags);
+    MicroFlagType type = b->flags[flag].type;
+    if (type != MICRO_FLAG_BOOL && i + 1 == argc)
+    {
+      // No room for the value, give it after an equal sign
+      char buf[96];
+      snprintf(buf, sizeof(buf), "%s=%s", b->names[flag],
+               type == MICRO_FLAG_INT ? "12345"
+               : type == MICRO_FLAG_DOUBLE ? "3.25" : "value");
+      b->argv[i] = strdup(buf);
+      if (b->argv[i] == NULL)
+        return false;
+      continue;
+    }
+    b->argv[i] = strdup(b->names[flag]);
+    if (b->argv[i] == NULL)
+      return false;
+    if (type == MICRO_FLAG_BOOL)
+      continue;
+    b->argv[++i] = strdup(type == MICRO_FLAG_INT ? "12345"
+                          : type == MICRO_FLAG_DOUBLE ? "3.25" : "value");
+    if (b->argv[i] == NULL)
+      return false;
+  }
+  return true;
+}
+
+static void bench_free(Bench *b)
+{
+  if (b->argv)
+    for (int i = 1; i < b->argc; ++i)
+      free(b->argv[i]);
+  if (b->names)
+    for (unsigned int i = 0; i < b->num_flags; ++i)
+      free(b->names[i]);
+  free(b->argv);
+  free(b->values);
+  free(b->options);
+  free(b->names);
+  free(b->flags);
+}
+
+// Parse the arguments of [b] with getopt_long, converting the values
+// like micro-flag.h does
+//
+// Returns: true on success
+static bool bench_getopt(Bench *b)
+{
+  // Reinitialize glibc getopt. Every argument is an option or its
+  // value, so argv is never permuted
+  optind = 0;
+  opterr = 0;
+  int opt;
+  while ((opt = getopt_long(b->argc, b->argv, "+", b->options, NULL)) != -1)
+  {
+    if (opt < 0 || (unsigned int) opt >= b->num_flags)
+      return false;
+    void *value = &b->values[opt];
+    char *end;
+    switch (b->flags[opt].type)
+    {
+    case MICRO_FLAG_BOOL:
+      *(bool*) value = true;
+      break;
+    case MICRO_FLAG_INT:
+      *(int*) value = (int) strtol(optarg, &end, 10);
+      if (*end != '\0')
+        return false;
+      break;
+    case MICRO_FLAG_DOUBLE:
+      *(double*) value = strtod(optarg, &end);
+      if (*end != '\0')
+        return false;
+      break;
+    default:
+      *(char**) value = optarg;
+      break;
+    }
+  }
+  return true;
+}
+
+#ifdef __linux__
+
+static int bench_perf_event(uint64_t config, int group)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = PERF_TYPE_HARDWARE;
+  attr.config         = config;
+  attr.disabled       = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP;
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+#endif // __linux__
+
+// Open the counters of [perf] as one group
+//
+// Returns: true if the counters can be read
+static bool bench_perf_open(BenchPerf *perf)
+{
+  perf->fd = -1;
+#ifdef __linux__
+  int fd = bench_perf_event(PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (fd < 0)
+    return false;
+  if (bench_perf_event(PERF_COUNT_HW_BRANCH_MISSES, fd) < 0
+      || bench_perf_event(PERF_COUNT_HW_CACHE_MISSES, fd) < 0)
+  {
+    // The group is closed with the process
+    close(fd);
+    return false;
+  }
+  perf->fd = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
+static void bench_perf_start(BenchPerf *perf)
+{
+#ifdef __linux__
+  if (perf->fd < 0)
+    return;
+  ioctl(perf->fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+  (void) perf;
+#endif
+}
+
+static void bench_perf_stop(BenchPerf *perf)
+{
+#ifdef __linux__
+  if (perf->fd < 0)
+    return;
+  ioctl(perf->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  uint64_t data[4];
+  if (read(perf->fd, data, sizeof(data)) != (ssize_t) sizeof(data)
+      || data[0] != 3)
+    return;
+  perf->cycles        = data[1];
+  perf->branch_misses = data[2];
+  perf->cache_misses  = data[3];
+#else
+  (void) perf;
+#endif
+}
+
+// Parse the arguments of [b] with [strategy] for at least [min_time]
+// seconds and print the result
+//
+// Returns: true on success
+static bool bench_run(Bench *b, BenchStrategy strategy, int types,
+                      int names, double min_time, BenchPerf *perf)
+{
+  MicroFlagSet set;
+  MicroFlagContext ctx;
+  if (strategy != BENCH_GETOPT)
+  {
+    MicroFlagError err = micro_flag_compile(&set, b->flags, b->num_flags);
+    if (err == MICRO_FLAG_OK && strategy == BENCH_TRIE)
+      err = micro_flag_compile_trie(&set);
+    if (err == MICRO_FLAG_OK && strategy == BENCH_SIMD)
+      err = micro_flag_compile_simd(&set);
+    if (err != MICRO_FLAG_OK)
+      return false;
+    micro_flag_context_init(&ctx, b->values);
+  }
+
+  // Double the iterations until the measure is long enough
+  unsigned long long iterations = 0;
+  double elapsed = 0;
+  bool ok = true;
+  perf->cycles = perf->branch_misses = perf->cache_misses = 0;
+  for (unsigned long long batch = 1; ok && elapsed < min_time * 1e9; batch *= 2)
+  {
+    bench_perf_start(perf);
+    double start = bench_now();
+    for (unsigned long long i = 0; ok && i < batch; ++i)
+    {
+      if (strategy == BENCH_GETOPT)
+        ok = bench_getopt(b);
+      else
+        ok = micro_flag_parse_r(&set, &ctx, b->argc, b->argv) == MICRO_FLAG_OK;
+    }
+    elapsed = bench_now() - start;
+    iterations = batch;
+    bench_perf_stop(perf);
+  }
+  if (strategy != BENCH_GETOPT)
+    micro_flag_free(&set);
+  if (!ok)
+    return false;
+
+  // Counters per argument, of the last batch only like the time
+  double args = b->argc > 1 ? (double) (b->argc - 1) : 1;
+  double per_parse = elapsed / iterations;
+  printf("%s,%u,%d,%s,%s,%llu,%.1f,%.2f",
+         bench_strategy_str[strategy], b->num_flags, b->argc,
+         bench_types_str[types], bench_names_str[names],
+         iterations, per_parse, per_parse / args);
+  if (perf->fd >= 0)
+    printf(",%.2f,%.4f,%.4f\n",
+           perf->cycles / (iterations * args),
+           perf->branch_misses / (iterations * args),
+           perf->cache_misses / (iterations * args));
+  else
+    printf(",,,\n");
+  fflush(stdout);
+  return true;
+}
+
+// Split the comma separated [list] into at most [cap] [values]
+//
+// Returns: the number of values, or -1 if there are too many
+static int bench_split(char *list, char **values, int cap)
+{
+  int count = 0;
+  for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+  {
+    if (count == cap)
+      return -1;
+    values[count++] = tok;
+  }
+  return count;
+}
+
+int main(int argc, char** argv)
+{
+  // Lists are split in place, so the defaults must be writable
+  char default_flags[]      = "4,16,64,256,1024,10000";
+  char default_argc[]       = "1,10,100,1000,10000,100000";
+  char default_types[]      = "mixed";
+  char default_names[]      = "short,long";
+  char default_strategies[] = "hash,trie,simd,getopt";
+
+  Args args;
+  // Default values
+  args.show_help    = false;
+  args.flags        = default_flags;
+  args.argc         = default_argc;
+  args.types        = default_types;
+  args.names        = default_names;
+  args.strategies   = default_strategies;
+  args.min_time     = 0.01;
+  args.perf         = false;
+  args.getopt_limit = 1e8;
+
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL,   &args.show_help,    "-h", "--help",
+        "show help message" },
+      { MICRO_FLAG_STR,    &args.flags,        "-f", "--flags",
+        "sizes of the flag table" },
+      { MICRO_FLAG_STR,    &args.argc,         "-a", "--argc",
+        "values of argc, including the program name" },
+      { MICRO_FLAG_STR,    &args.types,        "-t", "--types",
+        "types of the flags: bool, int, str or mixed" },
+      { MICRO_FLAG_STR,    &args.names,        "-n", "--names",
+        "length of the flag names: short or long" },
+      { MICRO_FLAG_STR,    &args.strategies,   "-s", "--strategies",
+        "hash, trie, simd or getopt" },
+      { MICRO_FLAG_DOUBLE, &args.min_time,     "-m", "--min-time",
+        "minimum seconds of each measure" },
+      { MICRO_FLAG_BOOL,   &args.perf,         "-p", "--perf",
+        "read cycles, branch and cache misses" },
+      { MICRO_FLAG_DOUBLE, &args.getopt_limit, "-g", "--getopt-limit",
+        "skip getopt when flags times argc is above this" },
+    };
+
+  size_t num_flags = sizeof(flags) / sizeof(flags[0]);
+  if (micro_flag_parse(flags, num_flags, argc, argv) != MICRO_FLAG_OK)
+    return 1;
+
+  if (args.show_help)
+  {
+    micro_flag_print_help("bench",
+                          "Parse throughput of micro-flag.h, as CSV",
+                          flags,
+                          num_flags);
+    return 0;
+  }
+
+  char *sizes[32], *argcs[32], *types[8], *names[8], *strategies[8];
+  int num_sizes      = bench_split(args.flags, sizes, 32);
+  int num_argcs      = bench_split(args.argc, argcs, 32);
+  int num_types      = bench_split(args.types, types, 8);
+  int num_names      = bench_split(args.names, names, 8);
+  int num_strategies = bench_split(args.strategies, strategies, 8);
+  if (num_sizes < 0 || num_argcs < 0 || num_types < 0 || num_names < 0
+      || num_strategies < 0)
+  {
+    fprintf(stderr, "Error: too many values in a list\n");
+    return 1;
+  }
+
+  BenchPerf perf = { -1, 0, 0, 0 };
+  if (args.perf && !bench_perf_open(&perf))
+    fprintf(stderr, "Warning: could not open the perf counters\n");
+
+  printf("strategy,flags,argc,types,names,iterations,ns_per_parse,"
+         "ns_per_arg,cycles_per_arg,branch_misses_per_arg,"
+         "cache_misses_per_arg\n");
+  for (int s = 0; s < num_sizes; ++s)
+    for (int a = 0; a < num_argcs; ++a)
+      for (int t = 0; t < num_types; ++t)
+        for (int n = 0; n < num_names; ++n)
+        {
+          long size = strtol(sizes[s], NULL, 10);
+          long count = strtol(argcs[a], NULL, 10);
+          int type = bench_find(bench_types_str, 4, types[t]);
+          int name = bench_find(bench_names_str, 2, names[n]);
+          if (size < 1 || count < 1 || count > 1 << 30 || type < 0 || name < 0)
+          {
+            fprintf(stderr, "Error: bad configuration %s,%s,%s,%s\n",
+                    sizes[s], argcs[a], types[t], names[n]);
+            return 1;
+          }
+
+          Bench b;
+          if (!bench_init(&b, (unsigned int) size, (int) count, type, name))
+          {
+            fprintf(stderr, "Error: out of memory\n");
+            bench_free(&b);
+            return 1;
+          }
+          for (int k = 0; k < num_strategies; ++k)
+          {
+            int strategy = bench_find(bench_strategy_str, _BENCH_MAX,
+                                      strategies[k]);
+            if (strategy < 0)
+            {
+              fprintf(stderr, "Error: unknown strategy %s\n", strategies[k]);
+              bench_free(&b);
+              return 1;
+            }
+            // getopt_long compares each argument with every option
+            if (strategy == BENCH_GETOPT
+                && (double) size * count > args.getopt_limit)
+              continue;
+            if (!bench_run(&b, (BenchStrategy) strategy, type, name,
+                           args.min_time, &perf))
+            {
+              fprintf(stderr, "Error: %s failed on %ld flags, argc %ld\n",
+                      bench_strategy_str[strategy], size, count);
+              bench_free(&b);
+              return 1;
+            }
+          }
+          bench_free(&b);
+        }
+
+  return 0;
+}
@@ -71,6 +71,14 @@
 //    return 1;
 // ```
 //
+// Short flags made of a dash and one character can be clustered
+// like in POSIX utilities: "-xvf file" is the same as "-x -v -f file",
+// and values can be attached to them, as in "-n42" or "-ofile".
+// A cluster is all or nothing: if one of its characters is not a
+// flag, or its attached value is invalid, none of its flags is set.
+// Long flags take their value either from the next argument or
+// after an equal sign, as in "--output=file".
+//
 // You can use `micro_flag_print_help` to print the help message:
 //
 // ```
@@ -85,6 +93,171 @@
 //  }
 // ```
 //
+// If the same flags are used to parse many argument vectors, compile
+// them once into a MicroFlagSet. This checks for duplicate names and
+// builds a hash index, so looking up an argument does not depend on
+// the number of flags:
+//
+// ```
+// MicroFlagSet set;
+// if (micro_flag_compile(&set, flags, num_flags) != MICRO_FLAG_OK)
+//   return 1;
+// if (micro_flag_parse_set(&set, argc, argv) != MICRO_FLAG_OK)
+//   return 1;
+// micro_flag_free(&set);
+// ```
+//
+// To accept unique abbreviations of long flags, like "--out" for
+// "--output", also call `micro_flag_compile_trie(&set)` after
+// compiling the set.
+//
+// `micro_flag_compile_simd(&set)` instead compares a one byte hash of
+// each argument with those of 64 names at once, using SIMD
+// instructions, and only then whole names. It still scans the table,
+// so it only keeps up with the hash index in tables of up to about
+// 64 flags, and beats it only on long names, as `make bench` shows.
+// Measure your own table before choosing it.
+//
+// To share one table between threads, or between many result
+// structs, make it an offset table: store `MICRO_FLAG_OFFSET(Args,
+// member)` as the value of each flag and give the struct to fill
+// to the context of `micro_flag_parse_r`:
+//
+// ```
+// static const MicroFlag flags[] =
+//   {
+//     { MICRO_FLAG_INT, MICRO_FLAG_OFFSET(Args, a_number), "-n",
+//                       "--number", "print this number" },
+//   };
+// ...
+// Args args;
+// MicroFlagContext ctx;
+// micro_flag_context_init(&ctx, &args);
+// if (micro_flag_parse_r(&set, &ctx, argc, argv) != MICRO_FLAG_OK)
+//   return 1;
+// ```
+//
+// Arguments do not need to come from argv. `micro_flag_feed` parses
+// them one at a time and `micro_flag_finish` ends the parse, while
+// `micro_flag_parse_nul` and `micro_flag_parse_stream` parse null
+// separated arguments, like the output of "find -print0", from memory
+// or from a file descriptor. The stream is read through a fixed
+// window, so give the context a pool for the string values:
+//
+// ```
+// char window[4096], strings[4096];
+// micro_flag_context_init(&ctx, NULL);
+// micro_flag_context_strings(&ctx, strings, sizeof(strings));
+// if (micro_flag_parse_stream(&set, &ctx, STDIN_FILENO, window,
+//                             sizeof(window)) != MICRO_FLAG_OK)
+//   return 1;
+// ```
+//
+// On Linux, `micro_flag_parse_proc` parses the command line of another
+// process and `micro_flag_scan_procs` the one of every process, calling
+// back after each. Both read into a buffer you give them and parse it
+// in place; set `ctx.ignore_unknown` to pick out only your flags.
+//
+// Set `ctx.response_files` to expand "@path" arguments to the
+// arguments in the file at path, split at spaces, tabs and newlines
+// with shell like quotes and backslash escapes, as gcc does. Files
+// are mapped copy on write and split in place, and may include other
+// files but not themselves. Values can point into them, so they stay
+// mapped until `micro_flag_context_release(&ctx)`. Errors in a file
+// are reported at the index in argv of its "@path" argument.
+//
+// Settings can also come from a config file of "key = value" lines,
+// where each key is the whole long name of a flag without the dashes,
+// as in the environment. Parse the arguments after it, so that they
+// take precedence:
+//
+// ```
+// micro_flag_context_init(&ctx, NULL);
+// if (micro_flag_parse_config(&set, &ctx, "app.conf") != MICRO_FLAG_OK
+//     || micro_flag_parse_r(&set, &ctx, argc, argv) != MICRO_FLAG_OK)
+//   return 1;
+// ...
+// micro_flag_context_release(&ctx);
+// ```
+//
+// `micro_flag_parse_env(&set, &ctx, "APP_", environ)` reads flags from
+// environment variables: APP_OUTPUT sets "--output" and APP_DRY_RUN
+// sets "--dry-run". Call it first, so that a config file or the
+// arguments parsed after it override the environment.
+//
+// A whole command line stored as one string, like "tool -o 'a b.txt'",
+// is split like the shell would and parsed with
+// `micro_flag_parse_string`, in place, or with
+// `micro_flag_parse_string_copy` into a buffer you give it.
+//
+// Long running programs can reload their settings without locking
+// readers out. With MICRO_FLAG_THREADS defined, a MicroFlagReload
+// parses a fresh copy of a result struct each time it reloads, with a
+// function of yours that calls the parsers above, and publishes it with
+// an atomic pointer swap:
+//
+// ```
+// micro_flag_reload_init(&reload, &set, &defaults, sizeof(Args),
+//                        load_args, NULL, &errors);
+// micro_flag_reload_watch(&reload, "app.conf");  // optional, Linux
+// ...
+// // In each reader thread, once
+// micro_flag_reader_register(&reload, &reader);
+// // For each read
+// const Args *args = micro_flag_read_begin(&reload, &reader);
+// ...
+// micro_flag_read_end(&reader);
+// ```
+//
+// Call `micro_flag_reload` to reload, or `micro_flag_reload_poll` to
+// reload when the watched file changed. Old structs are freed once no
+// read that started before the swap is still running.
+//
+// Flags of type MICRO_FLAG_ATOMIC_INT, MICRO_FLAG_ATOMIC_DOUBLE and
+// MICRO_FLAG_ATOMIC_STR are parsed as usual and can be changed later,
+// while other threads read them, with
+// `micro_flag_set(&set, NULL, "--batch", "64")`, or with the result
+// struct instead of NULL for offset tables. Read them with
+// `micro_flag_load_int(&batch)` and friends, which never see a half
+// written value.
+//
+// Tools with many flags, of which a run only reads a few, can make
+// the parse lazy with `micro_flag_context_lazy(&ctx, lazy, num_flags)`:
+// char, int and double values are then only recorded, and converted
+// and checked when first read with `micro_flag_get_int(&set, &ctx,
+// "--number", &n)` and friends. Recorded values carry over from one
+// parse to the next, so a config file, the environment and argv
+// parsed in turn with one lazy context layer as usual; call
+// `micro_flag_context_clear_lazy(&ctx)` before parsing unrelated
+// input with it.
+//
+// Programs that parse large inputs can cache the result for the next
+// start: `micro_flag_cache_write(&set, &args, key, path)` saves the
+// values of the flags to a file, and `micro_flag_cache_load(&set, &ctx,
+// key, path)` maps it back, failing if the flags or the key changed.
+// Choose a key that hashes the inputs, like the arguments and the
+// modification times of the files they name.
+//
+// The help message is printed with its columns aligned and in a single
+// write. Programs that print it often, or want "--help=<filter>" to
+// show only some flags, can render it once and keep it:
+//
+// ```
+// MicroFlagHelp help;
+// const char *filter;
+// if (micro_flag_help_requested(argc, argv, "--help", &filter)
+//     && micro_flag_help_render(&help, &set, "example",
+//                               "A sample application") == MICRO_FLAG_OK)
+// {
+//   MicroFlagSink out = micro_flag_sink_fd(STDOUT_FILENO);
+//   micro_flag_help_write(&help, &out, filter);
+//   micro_flag_help_free(&help);
+// }
+// ```
+//
+// A filter like "--output" shows that flag, any other text the flags
+// whose line contains it.
+//
 // Check out the full example at the end of the header.
 //
 //
@@ -107,6 +280,26 @@
 #define MICRO_FLAG_MAJOR 0
 #define MICRO_FLAG_MINOR 1
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#if !defined(MICRO_FLAG_NO_POSIX) && (defined(__unix__) || defined(__APPLE__))
+  #define MICRO_FLAG_POSIX
+#endif
+
+#if defined(MICRO_FLAG_POSIX) && defined(__linux__)
+  #define MICRO_FLAG_LINUX
+#endif
+
+#ifdef MICRO_FLAG_THREADS
+  #include <pthread.h>
+#endif
+
+#if defined(MICRO_FLAG_THREADS) && (defined(__GNUC__) || defined(__clang__))
+  #define MICRO_FLAG_RELOAD
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -126,6 +319,21 @@ typedef enum {
   MICRO_FLAG_ERROR_UNKNOWN_FLAG,
   MICRO_FLAG_ERROR_NOT_AN_INT,
   MICRO_FLAG_ERROR_NOT_A_DOUBLE,
+  MICRO_FLAG_ERROR_DUPLICATE_FLAG,
+  MICRO_FLAG_ERROR_ALLOC,
+  MICRO_FLAG_ERROR_AMBIGUOUS_FLAG,
+  MICRO_FLAG_ERROR_UNEXPECTED_VALUE,
+  MICRO_FLAG_ERROR_NO_SPACE,
+  MICRO_FLAG_ERROR_TOO_LONG,
+  MICRO_FLAG_ERROR_UNTERMINATED,
+  MICRO_FLAG_ERROR_IO,
+  MICRO_FLAG_ERROR_INCLUDE_CYCLE,
+  MICRO_FLAG_ERROR_SYNTAX,
+  MICRO_FLAG_ERROR_NOT_A_BOOL,
+  MICRO_FLAG_ERROR_NOT_ATOMIC,
+  MICRO_FLAG_ERROR_BAD_CACHE,
+  MICRO_FLAG_ERROR_STALE_CACHE,
+  MICRO_FLAG_ERROR_NO_BASE,
   _MICRO_FLAG_ERROR_MAX,
 } MicroFlagError;
 
@@ -135,9 +343,19 @@ typedef enum {
   MICRO_FLAG_STR,
   MICRO_FLAG_INT,
   MICRO_FLAG_DOUBLE,
+  // Values that can be changed with micro_flag_set while other
+  // threads read them with micro_flag_load_*: an int, a double and a
+  // char* to a string that is never modified
+  MICRO_FLAG_ATOMIC_INT,
+  MICRO_FLAG_ATOMIC_DOUBLE,
+  MICRO_FLAG_ATOMIC_STR,
   _MICRO_FLAG_MAX,
 } MicroFlagType;
 
+#if defined(__GNUC__) || defined(__clang__)
+  #define MICRO_FLAG_ATOMICS
+#endif
+
 // A single flag
 typedef struct {
   // The type of value that should be set
@@ -146,6 +364,8 @@ typedef struct {
   // For example, if type is MICRO_FLAG_INT, then value should
   // contain a pointer to an integer variable. The value of the pointer
   // will be set to the parsed argument.
+  // In offset tables this is MICRO_FLAG_OFFSET of the value instead,
+  // see micro_flag_context_init.
   void *value;
   // Short flag (like "-h", "-o")
   char *short_name;
@@ -154,7 +374,323 @@ typedef struct {
   // A short description of this flag
   char *description;
 } MicroFlag;
-  
+
+#ifdef MICRO_FLAG_ATOMICS
+
+// Read the value of a MICRO_FLAG_ATOMIC_INT flag. The load is relaxed:
+// it never sees a torn value and costs the same as a plain load
+static inline int micro_flag_load_int(const int *value)
+{
+  return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+// Read the value of a MICRO_FLAG_ATOMIC_DOUBLE flag, relaxed
+static inline double micro_flag_load_double(const double *value)
+{
+  double v;
+  __atomic_load(value, &v, __ATOMIC_RELAXED);
+  return v;
+}
+
+// Read the value of a MICRO_FLAG_ATOMIC_STR flag. The pointer is
+// acquired, so the string it points to is complete
+static inline const char *micro_flag_load_str(char *const *value)
+{
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+#endif // MICRO_FLAG_ATOMICS
+
+// Store the offset of [member] in the struct [type] as the value of
+// a flag. Tables using it do not point to any variable, so they can
+// be static const and shared: each parse writes to the struct given
+// to micro_flag_context_init
+#define MICRO_FLAG_OFFSET(type, member) ((void*) offsetof(type, member))
+
+// A slot of the name index of a MicroFlagSet
+typedef struct {
+  // The name of the flag, either its short or long name
+  const char *name;
+  // Length of [name]
+  unsigned int len;
+  // Hash of [name], see micro_flag_hash
+  unsigned int hash;
+  // Index of the flag in the set, or -1 if the slot is empty
+  int flag;
+} MicroFlagSlot;
+
+// A node of the trie on the long names of a MicroFlagSet. Chains of
+// nodes with a single child are merged into the [label] of the node
+typedef struct {
+  // Bytes that all the names under this node share after the edge
+  // that leads to it. They point into one of the names
+  const char *label;
+  unsigned int label_len;
+  // The children of the node are the edges in
+  // [first, first + count) of the trie of the set
+  unsigned int first;
+  unsigned int count;
+  // Index of the flag whose long name ends at this node, or -1
+  int flag;
+  // Index of the only flag whose long name starts with the prefix
+  // of this node, -1 if there is none or -2 if there are many
+  int unique;
+} MicroFlagTrieNode;
+
+// Width in bytes of the zero padded names compared by the
+// SIMD kernels, see micro_flag_compile_simd
+#define MICRO_FLAG_SIMD_WIDTH 32
+
+// Compare the one byte [tag] of an argument against the 64 [tags] of
+// packed names
+//
+// Returns: a mask with bit i set if [tag] is equal to tag i
+typedef unsigned long long (*MicroFlagSimdMatchFn)(const unsigned char *tags,
+                                                   unsigned char tag);
+
+typedef struct MicroFlagSet MicroFlagSet;
+
+// Find the flag named [name] of [len] bytes in [set]
+//
+// Returns: the index of the flag in the set, -1 if not found or -2
+// if [name] is an ambiguous abbreviation
+typedef int (*MicroFlagLookupFn)(const MicroFlagSet *set,
+                                 const char *name,
+                                 size_t len);
+
+// A compiled set of flags, see micro_flag_compile
+struct MicroFlagSet {
+  // The flags of this set. They are not owned by the set
+  // and must outlive it
+  const MicroFlag *flags;
+  unsigned int num_flags;
+  // Open addressing hash index on the names of the flags.
+  // num_slots is always a power of two
+  MicroFlagSlot *slots;
+  unsigned int num_slots;
+  // Function used to find flags by name and its private data.
+  // This is micro_flag_lookup_hash unless the set was created
+  // with micro_flag_compile_with
+  MicroFlagLookupFn lookup;
+  const void *lookup_data;
+  // The lookup of the index of the set, before micro_flag_compile_trie
+  // or micro_flag_compile_simd replaced it. They fall back to it for
+  // the names they do not hold
+  MicroFlagLookupFn index_lookup;
+  // Trie on the long names built by micro_flag_compile_trie, stored
+  // as flat arrays. Node 0 is the root, edge i goes to the node
+  // trie_targets[i] with byte trie_bytes[i], then through its label
+  MicroFlagTrieNode *trie;
+  unsigned char *trie_bytes;
+  unsigned int *trie_targets;
+  // Names of the flags packed in zero padded blocks of
+  // MICRO_FLAG_SIMD_WIDTH bytes by micro_flag_compile_simd, a one
+  // byte hash of each block, padded to a multiple of 64, the flag of
+  // each name and the kernel chosen for this CPU
+  unsigned char *simd_names;
+  unsigned char *simd_tags;
+  int *simd_flags;
+  unsigned int simd_count;
+  MicroFlagSimdMatchFn simd_match;
+  // Flag of each short name made of a dash and a single byte,
+  // indexed by that byte, or -1
+  int short_flags[256];
+};
+
+// Structured record of the outcome of a parse
+typedef struct {
+  // MICRO_FLAG_OK, or the error that stopped the parse
+  MicroFlagError error;
+  // Index in argv of the argument that caused the error, or -1
+  int index;
+  // The argument that caused the error, or NULL
+  const char *arg;
+  // The flag involved in the error, or NULL
+  const MicroFlag *flag;
+} MicroFlagDiagnostic;
+
+// A response file read by a parse, kept while its arguments are in
+// use. See micro_flag_context_release
+typedef struct MicroFlagFile {
+  struct MicroFlagFile *next;
+  // Contents of the file, null terminated
+  char *data;
+  // Bytes mapped, or 0 if [data] was allocated
+  size_t mapped;
+  // Identity of the file, to detect include cycles
+  unsigned long long dev;
+  unsigned long long ino;
+  // The file is being expanded
+  bool open;
+} MicroFlagFile;
+
+// The value of a flag in lazy parses, see micro_flag_context_lazy
+typedef struct {
+  // The value given to the flag, NULL if it was not given
+  const char *raw;
+  // The argument that named the flag and its index, for errors
+  const char *arg;
+  int index;
+  // [raw] was converted, with this outcome
+  bool converted;
+  MicroFlagError error;
+} MicroFlagLazy;
+
+// State of a parse, owned by the caller of micro_flag_parse_r.
+// Initialize it with micro_flag_context_init
+typedef struct {
+  // Outcome of the parse
+  MicroFlagDiagnostic diag;
+  // If not NULL, the values of the flags are offsets from [base]
+  // made with MICRO_FLAG_OFFSET instead of pointers
+  void *base;
+  // Flag waiting for its value in the next argument, with the
+  // argument that named it and its index
+  const MicroFlag *pending;
+  const char *pending_arg;
+  int pending_index;
+  // Index of the last argument fed
+  int index;
+  // Skip unknown arguments instead of failing. Unknown flags
+  // that take a value in the next argument cannot be told apart
+  // from flags that take none, so the value is parsed on its own
+  bool ignore_unknown;
+  // Expand "@path" arguments to the arguments in the file at path.
+  // The files stay in [files] until micro_flag_context_release
+  bool response_files;
+  MicroFlagFile *files;
+  // Read files instead of mapping them. Truncating or rewriting a
+  // mapped file in place changes the values that point into it, so
+  // set this if files may change while the values are in use
+  bool copy_files;
+  // If not NULL, string values are copied to [strings] of
+  // [strings_cap] bytes, [strings_len] of which are used, instead of
+  // pointing to the arguments. See micro_flag_context_strings
+  char *strings;
+  size_t strings_cap;
+  size_t strings_len;
+  // If not NULL, char, int and double values are converted on first
+  // access instead of during the parse, from the [num_lazy] slots of
+  // [lazy]. See micro_flag_context_lazy
+  MicroFlagLazy *lazy;
+  unsigned int num_lazy;
+} MicroFlagContext;
+
+typedef enum {
+  // Discard everything
+  MICRO_FLAG_SINK_SILENT = 0,
+  // Write to a FILE*
+  MICRO_FLAG_SINK_FILE,
+  // Write to a file descriptor, one write per message
+  MICRO_FLAG_SINK_FD,
+  // Append to a caller provided buffer
+  MICRO_FLAG_SINK_BUFFER,
+} MicroFlagSinkType;
+
+// Destination of the messages of the library, see micro_flag_sink_*
+typedef struct {
+  MicroFlagSinkType type;
+  // MICRO_FLAG_SINK_FILE
+  FILE *file;
+  // MICRO_FLAG_SINK_FD
+  int fd;
+  // MICRO_FLAG_SINK_BUFFER: messages are appended to [buf] of [cap]
+  // bytes, which is always null terminated. [len] bytes are used,
+  // and [truncated] is set when a message did not fit
+  char *buf;
+  size_t cap;
+  size_t len;
+  bool truncated;
+} MicroFlagSink;
+
+// Help message rendered once, see micro_flag_help_render
+typedef struct {
+  const MicroFlagSet *set;
+  // The whole help, null terminated
+  char *text;
+  size_t len;
+  // Offset in [text] of the line of each flag, and of the end
+  size_t *lines;
+} MicroFlagHelp;
+
+#ifdef MICRO_FLAG_THREADS
+
+struct MicroFlagWorker;
+
+// Threads kept between parallel batches, see micro_flag_pool_init
+typedef struct {
+  // Workers, the calling thread of each batch being worker 0
+  unsigned int num_workers;
+  struct MicroFlagWorker *workers;
+  // The batch being parsed and the number of threads still on it.
+  // Workers wait on [start] for a new [generation], and the caller
+  // on [done], under [lock]
+  void *batch;
+  unsigned long long generation;
+  unsigned int running;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+} MicroFlagPool;
+
+#endif // MICRO_FLAG_THREADS
+
+#ifdef MICRO_FLAG_RELOAD
+
+// A published result struct, see MicroFlagReload
+typedef struct MicroFlagSnapshot {
+  // Next retired snapshot, and the epoch it was retired in
+  struct MicroFlagSnapshot *next;
+  unsigned long long retired;
+  // Context of the parse that filled the snapshot. It keeps the
+  // files that string values point into
+  MicroFlagContext ctx;
+  // The result struct
+  void *values;
+} MicroFlagSnapshot;
+
+// A thread that reads snapshots. Register it once with
+// micro_flag_reader_register
+typedef struct MicroFlagReader {
+  struct MicroFlagReader *next;
+  // Epoch in which the current read started, 0 outside of reads
+  unsigned long long epoch;
+} MicroFlagReader;
+
+// Fill a new snapshot by parsing with [ctx], whose base is the
+// result struct initialized to the defaults
+//
+// Returns: MICRO_FLAG_OK if the snapshot can be published
+typedef MicroFlagError (*MicroFlagLoadFn)(const MicroFlagSet *set,
+                                          MicroFlagContext *ctx,
+                                          void *data);
+
+// Result structs of [size] bytes, filled with the offset table
+// [set], that can be reloaded while other threads read them without
+// locks. Each reload fills a new struct and publishes it by swapping
+// a pointer; readers keep seeing the struct they started with, which
+// is freed once no reader can hold it anymore
+typedef struct {
+  const MicroFlagSet *set;
+  const void *defaults;
+  size_t size;
+  MicroFlagLoadFn load;
+  void *data;
+  // The published snapshot, and the epoch of its publication
+  MicroFlagSnapshot *current;
+  unsigned long long epoch;
+  // Registered readers and retired snapshots, under [lock]
+  MicroFlagReader *readers;
+  MicroFlagSnapshot *retired;
+  pthread_mutex_t lock;
+  // inotify descriptor of micro_flag_reload_watch, or -1
+  int watch_fd;
+  const char *watch_name;
+} MicroFlagReload;
+
+#endif // MICRO_FLAG_RELOAD
+
 //
 // Declarations
 //
@@ -162,12 +698,631 @@ typedef struct {
 // Parse [num_flags] [flags] from [argc] [argv]
 //
 // Returns: MICRO_FLAG_OK on success, or an error and prints and error
-// message in case parsing was not successful
+// message to stderr in case parsing was not successful
 MicroFlagError micro_flag_parse(MicroFlag *flags,
                                 unsigned int num_flags,
                                 int argc,
                                 char **argv);
 
+// Compile [num_flags] [flags] into [set], checking for duplicate
+// names and building a hash index on them. [flags] are not copied
+// and must outlive [set]. Free the set with micro_flag_free.
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_DUPLICATE_FLAG
+// if two flags share a name, or MICRO_FLAG_ERROR_ALLOC if the index
+// could not be allocated
+MicroFlagError micro_flag_compile(MicroFlagSet *set,
+                                  const MicroFlag *flags,
+                                  unsigned int num_flags);
+
+// Version of micro_flag_compile that writes the duplicate names to
+// [errors] instead of stderr. [errors] can be NULL to discard them
+//
+// Returns: the same as micro_flag_compile
+MicroFlagError micro_flag_compile_r(MicroFlagSet *set,
+                                    const MicroFlag *flags,
+                                    unsigned int num_flags,
+                                    MicroFlagSink *errors);
+
+// Initialize [set] with [num_flags] [flags] using a custom [lookup]
+// function instead of the hash index. [lookup_data] is stored in the
+// set for [lookup] to use. No memory is allocated, this is meant for
+// indexes built ahead of time like the one in micro-flag.hpp
+//
+// Returns: MICRO_FLAG_OK
+MicroFlagError micro_flag_compile_with(MicroFlagSet *set,
+                                       const MicroFlag *flags,
+                                       unsigned int num_flags,
+                                       MicroFlagLookupFn lookup,
+                                       const void *lookup_data);
+
+// Build a trie on the long names of the compiled [set] and look up
+// flags through it. Long flags are matched reading each byte of the
+// argument once, and can be abbreviated to any unique prefix longer
+// than "--", like "--out" for "--output". Other names are still
+// looked up in the index of the set
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_ALLOC if the
+// trie could not be allocated, in which case [set] is unchanged and
+// still looks flags up as before
+MicroFlagError micro_flag_compile_trie(MicroFlagSet *set);
+
+// Pack the names of the compiled [set] in zero padded blocks with a
+// one byte hash of each, and look up flags by comparing the hash of
+// the argument with 64 of them at once with SIMD instructions, then
+// the whole names that match. The kernel is chosen once here between
+// AVX2, SSE2 and a scalar fallback depending on the CPU. Names and
+// arguments longer than MICRO_FLAG_SIMD_WIDTH are looked up in the
+// index of the set. The table is still scanned: this only keeps up
+// with hashing in tables of up to about 64 flags, and is faster only
+// on long names
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_ALLOC if the
+// names could not be allocated, in which case [set] is unchanged and
+// still looks flags up as before
+MicroFlagError micro_flag_compile_simd(MicroFlagSet *set);
+
+// Free the memory allocated by micro_flag_compile,
+// micro_flag_compile_trie and micro_flag_compile_simd
+void micro_flag_free(MicroFlagSet *set);
+
+// Find the flag named [name] of [len] bytes in [set] using the lookup
+// function of the set. [name] does not need to be null terminated
+//
+// Returns: the index of the flag in the set, -1 if not found or -2
+// if [name] is an ambiguous abbreviation
+int micro_flag_lookup(const MicroFlagSet *set,
+                      const char *name,
+                      size_t len);
+
+// Find the flag named [name] of [len] bytes using the hash index
+// built by micro_flag_compile
+//
+// Returns: the index of the flag in the set, or -1 if not found
+int micro_flag_lookup_hash(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len);
+
+// Find the flag named [name] of [len] bytes using the trie built by
+// micro_flag_compile_trie, accepting unique abbreviations of long names
+//
+// Returns: the index of the flag in the set, -1 if not found or -2
+// if [name] is an ambiguous abbreviation
+int micro_flag_lookup_trie(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len);
+
+// Find the flag named [name] of [len] bytes using the packed names
+// built by micro_flag_compile_simd
+//
+// Returns: the index of the flag in the set, or -1 if not found
+int micro_flag_lookup_simd(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len);
+
+// Parse the flags of [set] from [argc] [argv]
+//
+// Returns: MICRO_FLAG_OK on success, or an error and prints and error
+// message to stderr in case parsing was not successful
+MicroFlagError micro_flag_parse_set(const MicroFlagSet *set,
+                                    int argc,
+                                    char **argv);
+
+// Initialize [ctx] for a parse. If [base] is not NULL, the flags
+// are an offset table: their values are MICRO_FLAG_OFFSET offsets
+// in the struct pointed by [base], which the parse fills
+void micro_flag_context_init(MicroFlagContext *ctx, void *base);
+
+// Reentrant version of micro_flag_parse_set. Nothing is printed and
+// no global state is touched: the details of an error are returned
+// in ctx->diag, see micro_flag_write_error. The set is only read,
+// so it can be shared by any number of threads parsing at the same
+// time; the only memory written is [ctx] and the values of the flags
+// that are found. Threads sharing a set should therefore parse into
+// different structs with an offset table, or not share variables
+//
+// Returns: MICRO_FLAG_OK on success, or the error also stored in [ctx]
+MicroFlagError micro_flag_parse_r(const MicroFlagSet *set,
+                                  MicroFlagContext *ctx,
+                                  int argc,
+                                  char **argv);
+
+// Copy the values of string flags parsed with [ctx] to [strings] of
+// [cap] bytes, instead of pointing to the arguments. This is needed
+// when the arguments do not outlive the values, like with
+// micro_flag_parse_stream
+void micro_flag_context_strings(MicroFlagContext *ctx,
+                                char *strings,
+                                size_t cap);
+
+// Make the parses done with [ctx] lazy: the values of char, int and
+// double flags are only recorded, in [lazy] of one entry for each
+// flag of the set, and converted by the first micro_flag_get_* that
+// reads them. The parse then costs the same whatever the number and
+// type of values, and a value that is never read is never
+// validated. Values are still written to the variables of the
+// flags, on first access, so the defaults stay there until then.
+// Slots survive from one parse to the next, so config, environment
+// and arguments parsed in turn layer as they do without [lazy]
+void micro_flag_context_lazy(MicroFlagContext *ctx,
+                             MicroFlagLazy *lazy,
+                             unsigned int num_flags);
+
+// Forget the values recorded by the lazy parses done with [ctx].
+// Call it before parsing unrelated input with the same context, or
+// before freeing or reusing the buffers the recorded values point
+// into, like the arena of micro_flag_parse_string_copy
+void micro_flag_context_clear_lazy(MicroFlagContext *ctx);
+
+// Get the value of the int flag [name] of [set] parsed with [ctx],
+// converting it if it is the first access of a lazy parse. Accesses
+// are not thread safe, they write the cached value and [ctx]
+//
+// Returns: MICRO_FLAG_OK and the value of the flag, or its default
+// if it was not given, in [out]; MICRO_FLAG_ERROR_UNKNOWN_FLAG,
+// MICRO_FLAG_ERROR_UNKNOWN_TYPE if the flag is not an int, or the
+// conversion error, also stored in ctx->diag
+MicroFlagError micro_flag_get_int(const MicroFlagSet *set,
+                                  MicroFlagContext *ctx,
+                                  const char *name,
+                                  int *out);
+
+// Like micro_flag_get_int, for double flags
+MicroFlagError micro_flag_get_double(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     const char *name,
+                                     double *out);
+
+// Like micro_flag_get_int, for char flags
+MicroFlagError micro_flag_get_char(const MicroFlagSet *set,
+                                   MicroFlagContext *ctx,
+                                   const char *name,
+                                   char *out);
+
+// Free the response files read by the parses done with [ctx]. The
+// string values that point into them are no longer valid
+void micro_flag_context_release(MicroFlagContext *ctx);
+
+// Parse the single argument [arg] with [ctx]. Together with
+// micro_flag_finish this lets arguments come from anywhere, one at a
+// time: a flag that takes a value gets it from the next argument fed
+//
+// Returns: MICRO_FLAG_OK on success, or the error also stored in [ctx]
+MicroFlagError micro_flag_feed(const MicroFlagSet *set,
+                               MicroFlagContext *ctx,
+                               char *arg);
+
+// End a parse done with micro_flag_feed
+//
+// Returns: MICRO_FLAG_OK on success, or an error if the last flag
+// fed is still waiting for its value
+MicroFlagError micro_flag_finish(const MicroFlagSet *set,
+                                 MicroFlagContext *ctx);
+
+// Parse the null terminated arguments stored one after the other in
+// [buf] of [len] bytes, as written by "find -print0". There is no
+// program name to skip. String values point into [buf]
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_UNTERMINATED if
+// the last argument is not null terminated, or a parse error
+MicroFlagError micro_flag_parse_nul(const MicroFlagSet *set,
+                                    MicroFlagContext *ctx,
+                                    char *buf,
+                                    size_t len);
+
+// Split [str] in words like the POSIX shell and parse them, as if
+// they were the arguments of a program. The first word is the program
+// name and is skipped, like argv[0]. Words are separated by spaces,
+// tabs and newlines, quotes and backslashes work as in the shell, but
+// there are no expansions. [str] is split in place and string values
+// point into it
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_UNTERMINATED
+// if a quote is not closed, or a parse error
+MicroFlagError micro_flag_parse_string(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       char *str);
+
+// Like micro_flag_parse_string, but split a copy of [str] in [arena]
+// of [cap] bytes, which must fit it with its terminator
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_NO_SPACE if
+// [str] does not fit in [arena], or the errors of
+// micro_flag_parse_string
+MicroFlagError micro_flag_parse_string_copy(const MicroFlagSet *set,
+                                            MicroFlagContext *ctx,
+                                            const char *str,
+                                            char *arena,
+                                            size_t cap);
+
+#ifdef MICRO_FLAG_POSIX
+
+// Parse the null separated arguments read from [fd] until its end,
+// in the "xargs -0" format, without ever holding all of them. [buf]
+// of [cap] bytes is a sliding window over the input and must fit the
+// longest argument. Since the window is reused, string values are
+// only valid after the parse if [ctx] has a string pool, see
+// micro_flag_context_strings. On error, ctx->diag.arg points into [buf]
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_TOO_LONG if an
+// argument does not fit in [buf], MICRO_FLAG_ERROR_IO if reading
+// failed, or a parse error
+MicroFlagError micro_flag_parse_stream(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       int fd,
+                                       char *buf,
+                                       size_t cap);
+
+// Parse the config file at [path] into the flags of [set]. Each
+// line is "key = value", where key is the long name of a flag
+// without the leading dashes, like "output = file.txt" for
+// "--output". Keys must be whole names, even in a set compiled with
+// micro_flag_compile_trie. Boolean flags take true, yes, on, 1 or
+// false, no, off, 0. Spaces around keys and values are ignored, and
+// so are quotes around values, empty lines and lines starting with
+// '#' or ';'. The file is mapped and parsed in place: it stays in
+// [ctx], as string values point into it, until
+// micro_flag_context_release. Parse the arguments after the config
+// file, so that they override it. On error, ctx->diag.index is the
+// line number
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_IO if the
+// file cannot be read, MICRO_FLAG_ERROR_SYNTAX if a line has no '=',
+// or a parse error
+MicroFlagError micro_flag_parse_config(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       const char *path);
+
+#endif // MICRO_FLAG_POSIX
+
+// Parse the environment variables in [envp] that start with [prefix]
+// into the flags of [set]: the rest of the name of the variable, in
+// upper case and with '_' for '-', is the long name of a flag. With
+// prefix "APP_", APP_OUTPUT sets "--output" and APP_DRY_RUN sets
+// "--dry-run". Boolean flags take the same values as in config
+// files. Other variables are ignored. The environment is scanned
+// once, looking up each name in the set, and string values point
+// into it. Pass environ, or the third argument of main, as [envp].
+// On error, ctx->diag.index is the index of the variable in [envp]
+//
+// Returns: MICRO_FLAG_OK on success, or a parse error
+MicroFlagError micro_flag_parse_env(const MicroFlagSet *set,
+                                    MicroFlagContext *ctx,
+                                    const char *prefix,
+                                    char **envp);
+
+#ifdef MICRO_FLAG_LINUX
+
+// Called by micro_flag_scan_procs for each process, with the result
+// of parsing its command line in [ctx]
+//
+// Returns: 0 to continue the scan, anything else to stop it
+typedef int (*MicroFlagProcFn)(int pid, MicroFlagContext *ctx, void *data);
+
+// Parse the command line of the process [pid], as found in
+// /proc/<pid>/cmdline, skipping its name. The file is read with a
+// single read into [buf] of [cap] bytes and parsed in place, so
+// string values point into [buf]. Set ctx->ignore_unknown to only
+// pick the flags of [set] from a foreign command line
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_IO if the
+// process does not exist or cannot be read, MICRO_FLAG_ERROR_TOO_LONG
+// if the command line does not fit in [buf], or a parse error
+MicroFlagError micro_flag_parse_proc(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     int pid,
+                                     char *buf,
+                                     size_t cap);
+
+// Parse the command line of every process in /proc, like
+// micro_flag_parse_proc, and call [fn] with [data] after each one.
+// [buf] and [ctx] are reused for all processes and nothing is
+// allocated per process: [fn] must consume the values, which are
+// overwritten by the next process, and reset those it needs to.
+// Processes that cannot be read and kernel threads are skipped;
+// parse errors are passed to [fn] in ctx->diag
+//
+// Returns: MICRO_FLAG_OK, or MICRO_FLAG_ERROR_IO if /proc cannot be
+// read
+MicroFlagError micro_flag_scan_procs(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     char *buf,
+                                     size_t cap,
+                                     MicroFlagProcFn fn,
+                                     void *data);
+
+#endif // MICRO_FLAG_LINUX
+
+// Parse [n] argument vectors with the offset table of [set]. The
+// vector argvs[i] of argcs[i] arguments is parsed into the struct at
+// [base] + i * [stride] and its outcome is stored in results[i]. A
+// failed parse does not stop the others
+//
+// Returns: MICRO_FLAG_OK if all the parses succeeded, or the error
+// of the first one that failed
+MicroFlagError micro_flag_parse_batch(const MicroFlagSet *set,
+                                      char ***argvs,
+                                      const int *argcs,
+                                      size_t n,
+                                      void *base,
+                                      size_t stride,
+                                      MicroFlagDiagnostic *results);
+
+#ifdef MICRO_FLAG_THREADS
+
+// Start the [num_threads] - 1 threads of [pool]: with the thread that
+// calls micro_flag_parse_batch_pool they parse [num_threads] shares
+// of each batch. The threads wait between batches until
+// micro_flag_pool_free. If some cannot be started, the pool runs with
+// fewer. Needs MICRO_FLAG_THREADS and linking with pthreads
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_ALLOC
+MicroFlagError micro_flag_pool_init(MicroFlagPool *pool,
+                                    unsigned int num_threads);
+
+// Stop and join the threads of [pool]
+void micro_flag_pool_free(MicroFlagPool *pool);
+
+// Like micro_flag_parse_batch, splitting the vectors across the
+// threads of [pool] and the calling one. The vectors are cut in
+// chunks and each thread starts with a contiguous share of them;
+// threads that finish early steal chunks from the others. Each item
+// is written only to its own struct and result, so the outcome is the
+// same as micro_flag_parse_batch whatever the scheduling. The flags
+// must be an offset table, and [base] not NULL: with pointers all the
+// threads would write the same variables. A pool parses one batch at
+// a time, do not share it between threads that start batches
+//
+// Returns: MICRO_FLAG_OK if all the parses succeeded, the error of
+// the first one in input order that failed, or
+// MICRO_FLAG_ERROR_NO_BASE if [base] is NULL
+MicroFlagError micro_flag_parse_batch_pool(MicroFlagPool *pool,
+                                           const MicroFlagSet *set,
+                                           char ***argvs,
+                                           const int *argcs,
+                                           size_t n,
+                                           void *base,
+                                           size_t stride,
+                                           MicroFlagDiagnostic *results);
+
+// micro_flag_parse_batch_pool on a pool of [num_threads] threads
+// started for this batch only. Keep a MicroFlagPool instead to parse
+// many batches. If the pool cannot be created, the batch is parsed
+// on the calling thread
+//
+// Returns: the same as micro_flag_parse_batch_pool
+MicroFlagError micro_flag_parse_batch_parallel(const MicroFlagSet *set,
+                                               char ***argvs,
+                                               const int *argcs,
+                                               size_t n,
+                                               void *base,
+                                               size_t stride,
+                                               MicroFlagDiagnostic *results,
+                                               unsigned int num_threads);
+
+#endif // MICRO_FLAG_THREADS
+
+#ifdef MICRO_FLAG_RELOAD
+
+// Initialize [reload] and publish its first snapshot: a copy of
+// [defaults], of [size] bytes, filled by [load] called with [data].
+// [load] usually calls micro_flag_parse_config, micro_flag_parse_env
+// or micro_flag_parse_r, in the order of their precedence. Needs
+// MICRO_FLAG_THREADS
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_ALLOC, or the
+// error of [load]. Error messages are written to [errors], if not NULL.
+// Call micro_flag_reload_free even if it fails
+MicroFlagError micro_flag_reload_init(MicroFlagReload *reload,
+                                      const MicroFlagSet *set,
+                                      const void *defaults,
+                                      size_t size,
+                                      MicroFlagLoadFn load,
+                                      void *data,
+                                      MicroFlagSink *errors);
+
+// Fill a new snapshot with the load function and publish it. On
+// error the current snapshot stays published. Snapshots that no
+// reader can still hold are freed. Reloads may run in any thread,
+// one at a time
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_ALLOC, or the
+// error of the load function, whose message is written to [errors]
+// if not NULL
+MicroFlagError micro_flag_reload(MicroFlagReload *reload,
+                                 MicroFlagSink *errors);
+
+// Free all the snapshots of [reload]. No reader may be reading
+void micro_flag_reload_free(MicroFlagReload *reload);
+
+// Add [reader] to the readers of [reload], before its first read
+void micro_flag_reader_register(MicroFlagReload *reload,
+                                MicroFlagReader *reader);
+
+// Remove [reader] from the readers of [reload], outside of a read
+void micro_flag_reader_unregister(MicroFlagReload *reload,
+                                  MicroFlagReader *reader);
+
+// Start a read of the published snapshot. Nothing is locked: the
+// snapshot just stays valid until micro_flag_read_end, even if a
+// reload publishes a new one meanwhile. Reads do not nest
+//
+// Returns: the result struct of the snapshot
+const void *micro_flag_read_begin(MicroFlagReload *reload,
+                                  MicroFlagReader *reader);
+
+// End the read started by micro_flag_read_begin
+void micro_flag_read_end(MicroFlagReader *reader);
+
+#ifdef MICRO_FLAG_LINUX
+
+// Watch the file at [path] with inotify, so that
+// micro_flag_reload_poll reloads when it is written or replaced. The
+// directory of the file is watched, so that editors that save by
+// renaming a new file over it are seen too. [path] must outlive
+// [reload]. reload->watch_fd can be added to poll or epoll
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_IO
+MicroFlagError micro_flag_reload_watch(MicroFlagReload *reload,
+                                       const char *path);
+
+// Reload if the watched file changed since the last call, without
+// blocking
+//
+// Returns: MICRO_FLAG_OK if nothing changed or the reload succeeded,
+// or the error of micro_flag_reload
+MicroFlagError micro_flag_reload_poll(MicroFlagReload *reload,
+                                      MicroFlagSink *errors);
+
+#endif // MICRO_FLAG_LINUX
+
+#endif // MICRO_FLAG_RELOAD
+
+// Change the value of the atomic flag [name] of [set], written to
+// [base] for offset tables, to [value], converted as in the
+// arguments, while other threads may be reading it. The store never
+// tears. String values are not copied and must outlive the readers
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_UNKNOWN_FLAG,
+// MICRO_FLAG_ERROR_NOT_ATOMIC if the flag is not of an atomic type,
+// or a conversion error, in which case the value is unchanged
+MicroFlagError micro_flag_set(const MicroFlagSet *set,
+                              void *base,
+                              const char *name,
+                              const char *value);
+
+// Serialize the values of the flags of [set], read from [base] for
+// offset tables, to a cache blob in [buf] of [cap] bytes. The blob
+// holds the values and a pool of the strings, without pointers, and
+// is tagged with a hash of the types and names of the flags and with
+// [key], a hash of the inputs the values were parsed from, chosen by
+// the caller. Blobs are only meant for the machine that wrote them.
+// Atomic flags are read like micro_flag_load_* does, so other threads
+// may micro_flag_set them meanwhile
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_NO_SPACE if
+// [buf] is NULL or too small. The size of the blob is written to
+// [len] in both cases
+MicroFlagError micro_flag_cache_save(const MicroFlagSet *set,
+                                     void *base,
+                                     unsigned long long key,
+                                     void *buf,
+                                     size_t cap,
+                                     size_t *len);
+
+// Set the flags of [set] from the cache blob [blob] of [len] bytes,
+// written by micro_flag_cache_save with the same [key]. String
+// values point into [blob]. Nothing is written unless the whole blob
+// is valid. Atomic flags are written like micro_flag_set does
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_STALE_CACHE if
+// the flags or [key] changed since the blob was written, or
+// MICRO_FLAG_ERROR_BAD_CACHE if it is not a valid blob
+MicroFlagError micro_flag_cache_apply(const MicroFlagSet *set,
+                                      MicroFlagContext *ctx,
+                                      unsigned long long key,
+                                      const void *blob,
+                                      size_t len);
+
+#ifdef MICRO_FLAG_POSIX
+
+// Save a cache blob, see micro_flag_cache_save, to the file at
+// [path]. The file is replaced atomically, so processes that are
+// loading it are not affected
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_IO, or
+// MICRO_FLAG_ERROR_ALLOC
+MicroFlagError micro_flag_cache_write(const MicroFlagSet *set,
+                                      void *base,
+                                      unsigned long long key,
+                                      const char *path);
+
+// Map the cache blob at [path] and set the flags of [set] from it,
+// see micro_flag_cache_apply. Nothing is copied: the file stays
+// mapped in [ctx], as string values point into it, until
+// micro_flag_context_release
+//
+// Returns: MICRO_FLAG_OK on success, MICRO_FLAG_ERROR_IO if the file
+// cannot be read, or the errors of micro_flag_cache_apply. Parse the
+// inputs as usual on error
+MicroFlagError micro_flag_cache_load(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     unsigned long long key,
+                                     const char *path);
+
+#endif // MICRO_FLAG_POSIX
+
+// Create a sink that discards all messages
+MicroFlagSink micro_flag_sink_silent(void);
+
+// Create a sink that writes to [file]
+MicroFlagSink micro_flag_sink_file(FILE *file);
+
+// Create a sink that writes to the file descriptor [fd]
+MicroFlagSink micro_flag_sink_fd(int fd);
+
+// Create a sink that appends to [buf] of [cap] bytes, truncating the
+// messages that do not fit
+MicroFlagSink micro_flag_sink_buffer(char *buf, size_t cap);
+
+// Write a printf style message to [sink]
+void micro_flag_sink_printf(MicroFlagSink *sink, const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+  __attribute__((format(printf, 2, 3)))
+#endif
+  ;
+
+// Write the [len] bytes of [data] to [sink], in a single write for
+// file descriptors
+void micro_flag_sink_write(MicroFlagSink *sink, const char *data, size_t len);
+
+// Write the error message of [diag] to [sink], if it has an error
+void micro_flag_write_error(MicroFlagSink *sink,
+                            const MicroFlagDiagnostic *diag);
+
+// Render the help message of the flags of [set] into [help], with the
+// names and the descriptions of the flags in aligned columns. Render
+// it once and write it with micro_flag_help_write as many times as
+// needed
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_ALLOC
+MicroFlagError micro_flag_help_render(MicroFlagHelp *help,
+                                      const MicroFlagSet *set,
+                                      const char *prog_name,
+                                      const char *description);
+
+// Free the text of [help]
+void micro_flag_help_free(MicroFlagHelp *help);
+
+// Write [help] to [sink] with a single write, or writev for file
+// descriptors. If [filter] is not NULL, only the flags it names, like
+// "--output" or an abbreviation of it, are written or, if it names
+// none, those whose names or description contain it
+//
+// Returns: the number of flags written
+unsigned int micro_flag_help_write(const MicroFlagHelp *help,
+                                   MicroFlagSink *sink,
+                                   const char *filter);
+
+// Find the help flag [name], like "--help", in [argc] [argv], alone
+// or as "--help=filter". [filter] is set to the filter, or NULL
+//
+// Returns: true if the flag was found
+bool micro_flag_help_requested(int argc,
+                               char **argv,
+                               const char *name,
+                               const char **filter);
+
+// Write the help message with [flags] information to [sink], see
+// micro_flag_print_help
+//
+// Returns: MICRO_FLAG_OK on success, or an error.
+MicroFlagError micro_flag_write_help(MicroFlagSink *sink,
+                                     const char* prog_name,
+                                     const char* description,
+                                     const MicroFlag *flags,
+                                     unsigned int num_flags);
+
 // Print the help message with [flags] information
 //
 // Args:
@@ -182,6 +1337,31 @@ MicroFlagError micro_flag_print_help(const char* prog_name,
                                      MicroFlag *flags,
                                      unsigned int num_flags);
 
+// Parse the decimal integer of [len] bytes at [str] into [out]. The
+// whole string must be an optional sign followed by digits. Unlike
+// strtol this does not depend on the locale and does not touch errno,
+// and it converts eight digits at a time
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_NOT_AN_INT
+// if [str] is not an integer or does not fit in an int
+MicroFlagError micro_flag_parse_int(const char *str,
+                                    size_t len,
+                                    int *out);
+
+// Parse the decimal floating point number of [len] bytes at [str]
+// into [out], correctly rounded. The whole string must be a number
+// like "-1.5", ".5", "1e-3", or "inf" or "nan". The decimal point is
+// always '.', whatever the locale, and errno is not touched. Numbers
+// too small for a double round to a denormal or to zero, like "1e-400"
+// to 0, and are not an error: strtod sets ERANGE for them, which
+// earlier versions of this library rejected
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_NOT_A_DOUBLE
+// if [str] is not a number or overflows a double
+MicroFlagError micro_flag_parse_double(const char *str,
+                                       size_t len,
+                                       double *out);
+
 // String representation of MicoFlagType
 extern const char* micro_flag_type_str[_MICRO_FLAG_MAX];
 
@@ -192,146 +1372,3531 @@ extern const char* micro_flag_type_str[_MICRO_FLAG_MAX];
 #ifdef MICRO_FLAG_IMPLEMENTATION
 
 #include <string.h>
-#include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
+#include <stdarg.h>
 #include <limits.h>
+#include <float.h>
+
+#ifdef MICRO_FLAG_POSIX
+  #include <unistd.h>
+  #include <errno.h>
+  #include <sys/uio.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+  #include <sys/mman.h>
+#endif
 
-const char *micro_flag_type_str[] = { "", "<char>", "<str>", "<int>", "<double>" };
+#ifdef MICRO_FLAG_LINUX
+  #include <dirent.h>
+#endif
 
-MicroFlagError micro_flag_parse(MicroFlag *flags,
-                                unsigned int num_flags,
-                                int argc,
-                                char **argv)
+#if defined(MICRO_FLAG_RELOAD) && defined(MICRO_FLAG_LINUX)
+  #include <sys/inotify.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define MICRO_FLAG_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+  #define MICRO_FLAG_PREFETCH(addr) ((void) (addr))
+#endif
+
+#if !defined(MICRO_FLAG_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__GNUC__) || defined(__clang__))
+  #define MICRO_FLAG_X86_SIMD
+  #include <immintrin.h>
+#endif
+
+// SSE2 is part of x86-64, and of any 32 bit target that sets
+// __SSE2__, so byte scans use it without asking the CPU
+#if defined(MICRO_FLAG_X86_SIMD) && defined(__SSE2__)
+  #define MICRO_FLAG_SSE2
+#endif
+
+const char *micro_flag_type_str[] =
+  { "", "<char>", "<str>", "<int>", "<double>", "<int>", "<double>", "<str>" };
+
+// FNV-1a hash of [len] bytes of [name]
+static unsigned int micro_flag_hash(const char *name, size_t len)
 {
-  for (int i = 1; i < argc; ++i)
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
   {
-    bool found = false;
-    char *endptr;
-    for (unsigned int flag = 0; flag < num_flags; ++flag)
+    hash ^= (unsigned char) name[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static MicroFlagError micro_flag_index_name(MicroFlagSet *set,
+                                            const char *name,
+                                            int flag,
+                                            MicroFlagSink *errors)
+{
+  size_t len = strlen(name);
+  unsigned int hash = micro_flag_hash(name, len);
+  unsigned int mask = set->num_slots - 1;
+  for (unsigned int i = hash & mask;; i = (i + 1) & mask)
+  {
+    MicroFlagSlot *slot = &set->slots[i];
+    if (slot->flag == -1)
     {
-      if ((flags[flag].short_name && strcmp(flags[flag].short_name, argv[i]) == 0)
-          || (flags[flag].long_name && strcmp(flags[flag].long_name, argv[i]) == 0))
-      {
-        found = true;
-        switch (flags[flag].type)
-        {
-        case MICRO_FLAG_BOOL:
-          *((bool*) flags[flag].value) = true;
-          break;
-        case MICRO_FLAG_CHAR:
-          if (i + 1 >= argc)
-          {
-            printf("Usage: %s,%s <char>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_MISSING_CHAR;
-          }
-          if (strlen(argv[i+1]) != 1)
-          {
-            printf("Usage: %s,%s <char>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_CHAR_WRONG_ARG;
-          }
-          *((char*) flags[flag].value) = *argv[i+1];
-          i++;
-          break;
-        case MICRO_FLAG_STR:
-          if (i + 1 >= argc)
-          {
-            printf("Usage: %s,%s <string>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_MISSING_STR;
-          }
-          *((char**) flags[flag].value) = argv[i+1];
-          i++;
-          break;
-        case MICRO_FLAG_INT:
-          if (i + 1 >= argc)
-          {
-            printf("Usage: %s,%s <integer>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_MISSING_INT;
-          }
-
-          errno = 0;
-          long val_int = strtol(argv[i+1], &endptr, 10);
-          if (endptr == argv[i+1] || errno == ERANGE
-              || val_int > INT_MAX || val_int < INT_MIN)
-          {
-            printf("Usage: %s,%s <integer>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_NOT_AN_INT;
-          }
-          *((int*) flags[flag].value) = val_int;
-          i++;
-          break;
-        case MICRO_FLAG_DOUBLE:
-          if (i + 1 >= argc)
-          {
-            printf("Usage: %s,%s <double>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_MISSING_DOUBLE;
-          }
-
-          errno = 0;
-          double val_double = strtod(argv[i+1], &endptr);
-          if (endptr == argv[i+1] || errno == ERANGE)
-          {
-            printf("Usage: %s,%s <double>\n",
-                   flags[flag].short_name,
-                   flags[flag].long_name);
-            return MICRO_FLAG_ERROR_NOT_A_DOUBLE;
-          }
-          *((double*) flags[flag].value) = val_double;
-          i++;
-          break;
-        default:
-          return MICRO_FLAG_ERROR_UNKNOWN_TYPE;
-        }
+      slot->name = name;
+      slot->len  = (unsigned int) len;
+      slot->hash = hash;
+      slot->flag = flag;
+      return MICRO_FLAG_OK;
+    }
+    if (slot->hash == hash && slot->len == len
+        && memcmp(slot->name, name, len) == 0)
+    {
+      if (errors != NULL)
+        micro_flag_sink_printf(errors, "Error compiling flags: duplicate flag \"%s\"\n", name);
+      return MICRO_FLAG_ERROR_DUPLICATE_FLAG;
+    }
+  }
+}
+
+// Fill the direct dispatch table of the short names like "-h"
+static void micro_flag_index_short(MicroFlagSet *set)
+{
+  for (int c = 0; c < 256; ++c)
+    set->short_flags[c] = -1;
+  for (unsigned int flag = 0; flag < set->num_flags; ++flag)
+  {
+    const char *name = set->flags[flag].short_name;
+    if (name && name[0] == '-' && name[1] != '\0' && name[1] != '-'
+        && name[2] == '\0')
+      set->short_flags[(unsigned char) name[1]] = (int) flag;
+  }
+}
+
+MicroFlagError micro_flag_compile(MicroFlagSet *set,
+                                  const MicroFlag *flags,
+                                  unsigned int num_flags)
+{
+  MicroFlagSink sink = micro_flag_sink_file(stderr);
+  return micro_flag_compile_r(set, flags, num_flags, &sink);
+}
+
+MicroFlagError micro_flag_compile_r(MicroFlagSet *set,
+                                    const MicroFlag *flags,
+                                    unsigned int num_flags,
+                                    MicroFlagSink *errors)
+{
+  // Keep the load factor of the index at most 1/2
+  unsigned int num_slots = 4;
+  while (num_slots < 4 * num_flags)
+    num_slots *= 2;
+
+  set->flags        = flags;
+  set->num_flags    = num_flags;
+  set->lookup       = micro_flag_lookup_hash;
+  set->lookup_data  = NULL;
+  set->index_lookup = micro_flag_lookup_hash;
+  set->trie         = NULL;
+  set->trie_bytes   = NULL;
+  set->trie_targets = NULL;
+  set->simd_names   = NULL;
+  set->simd_tags    = NULL;
+  set->simd_flags   = NULL;
+  set->simd_count   = 0;
+  set->simd_match   = NULL;
+  set->num_slots    = num_slots;
+  set->slots        = (MicroFlagSlot*) malloc(num_slots * sizeof(MicroFlagSlot));
+  if (set->slots == NULL)
+    return MICRO_FLAG_ERROR_ALLOC;
+  for (unsigned int i = 0; i < num_slots; ++i)
+    set->slots[i].flag = -1;
+  micro_flag_index_short(set);
+
+  for (unsigned int flag = 0; flag < num_flags; ++flag)
+  {
+    MicroFlagError err = MICRO_FLAG_OK;
+    if (flags[flag].short_name)
+      err = micro_flag_index_name(set, flags[flag].short_name, (int) flag, errors);
+    if (err == MICRO_FLAG_OK && flags[flag].long_name)
+      err = micro_flag_index_name(set, flags[flag].long_name, (int) flag, errors);
+    if (err != MICRO_FLAG_OK)
+    {
+      micro_flag_free(set);
+      return err;
+    }
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_compile_with(MicroFlagSet *set,
+                                       const MicroFlag *flags,
+                                       unsigned int num_flags,
+                                       MicroFlagLookupFn lookup,
+                                       const void *lookup_data)
+{
+  set->flags        = flags;
+  set->num_flags    = num_flags;
+  set->slots        = NULL;
+  set->num_slots    = 0;
+  set->lookup       = lookup;
+  set->lookup_data  = lookup_data;
+  set->index_lookup = lookup;
+  set->trie         = NULL;
+  set->trie_bytes   = NULL;
+  set->trie_targets = NULL;
+  set->simd_names   = NULL;
+  set->simd_tags    = NULL;
+  set->simd_flags   = NULL;
+  set->simd_count   = 0;
+  set->simd_match   = NULL;
+  micro_flag_index_short(set);
+  return MICRO_FLAG_OK;
+}
+
+typedef struct {
+  const char *name;
+  int flag;
+} MicroFlagTrieKey;
+
+static int micro_flag_trie_key_cmp(const void *a, const void *b)
+{
+  return strcmp(((const MicroFlagTrieKey*) a)->name,
+                ((const MicroFlagTrieKey*) b)->name);
+}
+
+// Fill [node] with the sorted [keys] in [lo, hi), which share
+// their first [depth] bytes
+static void micro_flag_trie_build(MicroFlagSet *set,
+                                  const MicroFlagTrieKey *keys,
+                                  unsigned int lo,
+                                  unsigned int hi,
+                                  size_t depth,
+                                  unsigned int node,
+                                  unsigned int *num_nodes,
+                                  unsigned int *num_edges)
+{
+  MicroFlagTrieNode *n = &set->trie[node];
+  n->flag   = -1;
+  n->unique = (hi - lo == 1) ? keys[lo].flag : -2;
+
+  // The keys are sorted, if the first and the last share a byte all
+  // of them do. A single key takes the rest of its name
+  size_t label_len = 0;
+  while (keys[lo].name[depth + label_len] != '\0'
+         && keys[lo].name[depth + label_len] == keys[hi - 1].name[depth + label_len])
+    label_len++;
+  n->label     = keys[lo].name + depth;
+  n->label_len = (unsigned int) label_len;
+  depth += label_len;
+
+  // A name ending here sorts before all the longer ones
+  if (keys[lo].name[depth] == '\0')
+    n->flag = keys[lo++].flag;
+
+  n->first = *num_edges;
+  n->count = 0;
+  for (unsigned int i = lo; i < hi; ++i)
+    if (i == lo || keys[i].name[depth] != keys[i-1].name[depth])
+      n->count++;
+  *num_edges += n->count;
+
+  unsigned int edge = n->first;
+  for (unsigned int i = lo; i < hi; ++edge)
+  {
+    unsigned int end = i + 1;
+    while (end < hi && keys[end].name[depth] == keys[i].name[depth])
+      end++;
+    unsigned int child = (*num_nodes)++;
+    set->trie_bytes[edge]   = (unsigned char) keys[i].name[depth];
+    set->trie_targets[edge] = child;
+    micro_flag_trie_build(set, keys, i, end, depth + 1,
+                          child, num_nodes, num_edges);
+    i = end;
+  }
+}
+
+MicroFlagError micro_flag_compile_trie(MicroFlagSet *set)
+{
+  unsigned int num_keys = 0;
+  size_t total_len = 0;
+  for (unsigned int flag = 0; flag < set->num_flags; ++flag)
+  {
+    if (set->flags[flag].long_name)
+    {
+      num_keys++;
+      total_len += strlen(set->flags[flag].long_name);
+    }
+  }
+
+  // On failure the set keeps its index and its current lookup
+  MicroFlagTrieKey *keys =
+    (MicroFlagTrieKey*) malloc((num_keys + 1) * sizeof(MicroFlagTrieKey));
+  MicroFlagTrieNode *trie =
+    (MicroFlagTrieNode*) malloc((total_len + 1) * sizeof(MicroFlagTrieNode));
+  unsigned char *trie_bytes = (unsigned char*) malloc(total_len + 1);
+  unsigned int *trie_targets =
+    (unsigned int*) malloc((total_len + 1) * sizeof(unsigned int));
+  if (keys == NULL || trie == NULL || trie_bytes == NULL || trie_targets == NULL)
+  {
+    free(keys);
+    free(trie);
+    free(trie_bytes);
+    free(trie_targets);
+    return MICRO_FLAG_ERROR_ALLOC;
+  }
+  free(set->trie);
+  free(set->trie_bytes);
+  free(set->trie_targets);
+  set->trie         = trie;
+  set->trie_bytes   = trie_bytes;
+  set->trie_targets = trie_targets;
+
+  num_keys = 0;
+  for (unsigned int flag = 0; flag < set->num_flags; ++flag)
+  {
+    if (set->flags[flag].long_name)
+    {
+      keys[num_keys].name = set->flags[flag].long_name;
+      keys[num_keys].flag = (int) flag;
+      num_keys++;
+    }
+  }
+  qsort(keys, num_keys, sizeof(MicroFlagTrieKey), micro_flag_trie_key_cmp);
+
+  unsigned int num_nodes = 1, num_edges = 0;
+  if (num_keys > 0)
+  {
+    micro_flag_trie_build(set, keys, 0, num_keys, 0,
+                          0, &num_nodes, &num_edges);
+  }
+  else
+  {
+    set->trie[0].label     = NULL;
+    set->trie[0].label_len = 0;
+    set->trie[0].first     = 0;
+    set->trie[0].count     = 0;
+    set->trie[0].flag   = -1;
+    set->trie[0].unique = -1;
+  }
+  free(keys);
+
+  set->lookup = micro_flag_lookup_trie;
+  return MICRO_FLAG_OK;
+}
+
+void micro_flag_free(MicroFlagSet *set)
+{
+  free(set->slots);
+  free(set->trie);
+  free(set->trie_bytes);
+  free(set->trie_targets);
+  free(set->simd_names);
+  free(set->simd_tags);
+  free(set->simd_flags);
+  set->slots = NULL;
+  set->num_slots = 0;
+  set->trie = NULL;
+  set->trie_bytes = NULL;
+  set->trie_targets = NULL;
+  set->simd_names = NULL;
+  set->simd_tags = NULL;
+  set->simd_flags = NULL;
+  set->simd_count = 0;
+}
+
+int micro_flag_lookup(const MicroFlagSet *set,
+                      const char *name,
+                      size_t len)
+{
+  return set->lookup(set, name, len);
+}
+
+int micro_flag_lookup_hash(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len)
+{
+  if (set->num_slots == 0)
+    return -1;
+  unsigned int hash = micro_flag_hash(name, len);
+  unsigned int mask = set->num_slots - 1;
+  for (unsigned int i = hash & mask;; i = (i + 1) & mask)
+  {
+    const MicroFlagSlot *slot = &set->slots[i];
+    if (slot->flag == -1)
+      return -1;
+    if (slot->hash == hash && slot->len == len
+        && memcmp(slot->name, name, len) == 0)
+      return slot->flag;
+  }
+}
+
+int micro_flag_lookup_trie(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len)
+{
+  if (len < 2 || name[0] != '-' || name[1] != '-')
+    return set->index_lookup(set, name, len);
+
+  const MicroFlagTrieNode *node = &set->trie[0];
+  size_t i = 0;
+  for (;;)
+  {
+    // A name ending inside the label abbreviates all the names
+    // under the node
+    if (len - i < node->label_len)
+    {
+      if (memcmp(name + i, node->label, len - i) != 0)
+        return set->index_lookup(set, name, len);
+      break;
+    }
+    if (memcmp(name + i, node->label, node->label_len) != 0)
+      return set->index_lookup(set, name, len);
+    i += node->label_len;
+    if (i == len)
+    {
+      if (node->flag != -1)
+        return node->flag;
+      break;
+    }
+
+    const unsigned char *bytes = set->trie_bytes + node->first;
+    unsigned int edge = 0;
+    while (edge < node->count && bytes[edge] != (unsigned char) name[i])
+      edge++;
+    if (edge == node->count)
+      return set->index_lookup(set, name, len);
+    node = &set->trie[set->trie_targets[node->first + edge]];
+    i++;
+  }
+
+  // "--" alone is not an abbreviation
+  if (len == 2)
+    return -1;
+  return node->unique;
+}
+
+// One byte hash of a zero padded name of MICRO_FLAG_SIMD_WIDTH bytes,
+// mixing each of its words with a multiply
+static unsigned char micro_flag_simd_tag(const unsigned char *block)
+{
+  static const unsigned long long keys[4] =
+    { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full,
+      0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull };
+  unsigned long long h = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    unsigned long long w;
+    memcpy(&w, block + 8 * i, 8);
+    h += w * keys[i];
+  }
+  return (unsigned char) (h >> 56);
+}
+
+static unsigned long long micro_flag_simd_match_scalar(const unsigned char *tags,
+                                                       unsigned char tag)
+{
+  unsigned long long mask = 0;
+  for (unsigned int i = 0; i < 64; ++i)
+    mask |= (unsigned long long) (tags[i] == tag) << i;
+  return mask;
+}
+
+#ifdef MICRO_FLAG_X86_SIMD
+
+__attribute__((target("sse2")))
+static unsigned long long micro_flag_simd_match_sse2(const unsigned char *tags,
+                                                     unsigned char tag)
+{
+  __m128i t = _mm_set1_epi8((char) tag);
+  unsigned long long mask = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    __m128i eq = _mm_cmpeq_epi8(t, _mm_loadu_si128((const __m128i*) (tags + 16 * i)));
+    mask |= (unsigned long long) (unsigned int) _mm_movemask_epi8(eq) << (16 * i);
+  }
+  return mask;
+}
+
+__attribute__((target("avx2")))
+static unsigned long long micro_flag_simd_match_avx2(const unsigned char *tags,
+                                                     unsigned char tag)
+{
+  __m256i t = _mm256_set1_epi8((char) tag);
+  __m256i lo = _mm256_cmpeq_epi8(t, _mm256_loadu_si256((const __m256i*) tags));
+  __m256i hi = _mm256_cmpeq_epi8(t, _mm256_loadu_si256((const __m256i*) (tags + 32)));
+  return (unsigned long long) (unsigned int) _mm256_movemask_epi8(lo)
+    | (unsigned long long) (unsigned int) _mm256_movemask_epi8(hi) << 32;
+}
+
+#endif // MICRO_FLAG_X86_SIMD
+
+MicroFlagError micro_flag_compile_simd(MicroFlagSet *set)
+{
+  unsigned int count = 0;
+  for (unsigned int flag = 0; flag < set->num_flags; ++flag)
+  {
+    const char *names[2] = { set->flags[flag].short_name, set->flags[flag].long_name };
+    for (int n = 0; n < 2; ++n)
+      if (names[n] && strlen(names[n]) <= MICRO_FLAG_SIMD_WIDTH)
+        count++;
+  }
+
+  // The kernels read the tags 64 at a time
+  unsigned int num_tags = (count + 63) / 64 * 64;
+  // On failure the set keeps its index and its current lookup
+  unsigned char *simd_names =
+    (unsigned char*) calloc(count + 1, MICRO_FLAG_SIMD_WIDTH);
+  unsigned char *simd_tags = (unsigned char*) calloc(num_tags + 1, 1);
+  int *simd_flags = (int*) malloc((count + 1) * sizeof(int));
+  if (simd_names == NULL || simd_tags == NULL || simd_flags == NULL)
+  {
+    free(simd_names);
+    free(simd_tags);
+    free(simd_flags);
+    return MICRO_FLAG_ERROR_ALLOC;
+  }
+  free(set->simd_names);
+  free(set->simd_tags);
+  free(set->simd_flags);
+  set->simd_names = simd_names;
+  set->simd_tags  = simd_tags;
+  set->simd_flags = simd_flags;
+
+  set->simd_count = 0;
+  for (unsigned int flag = 0; flag < set->num_flags; ++flag)
+  {
+    const char *names[2] = { set->flags[flag].short_name, set->flags[flag].long_name };
+    for (int n = 0; n < 2; ++n)
+    {
+      if (names[n] == NULL || strlen(names[n]) > MICRO_FLAG_SIMD_WIDTH)
+        continue;
+      unsigned char *block = set->simd_names + set->simd_count * MICRO_FLAG_SIMD_WIDTH;
+      memcpy(block, names[n], strlen(names[n]));
+      set->simd_tags[set->simd_count]    = micro_flag_simd_tag(block);
+      set->simd_flags[set->simd_count++] = (int) flag;
+    }
+  }
+
+  set->simd_match = micro_flag_simd_match_scalar;
+#ifdef MICRO_FLAG_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    set->simd_match = micro_flag_simd_match_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    set->simd_match = micro_flag_simd_match_sse2;
+#endif
+
+  set->lookup = micro_flag_lookup_simd;
+  return MICRO_FLAG_OK;
+}
+
+int micro_flag_lookup_simd(const MicroFlagSet *set,
+                           const char *name,
+                           size_t len)
+{
+  if (len > MICRO_FLAG_SIMD_WIDTH)
+    return set->index_lookup(set, name, len);
+
+  unsigned char token[MICRO_FLAG_SIMD_WIDTH] = { 0 };
+  memcpy(token, name, len);
+  unsigned char tag = micro_flag_simd_tag(token);
+
+  // Compare the tags of 64 names at once, then the whole names of
+  // the few whose tag matches
+  for (unsigned int i = 0; i < set->simd_count; i += 64)
+  {
+    unsigned long long mask = set->simd_match(set->simd_tags + i, tag);
+    if (set->simd_count - i < 64)
+      mask &= (1ull << (set->simd_count - i)) - 1;
+    for (; mask != 0; mask &= mask - 1)
+    {
+      unsigned int bit = 0;
+      while (!(mask & (1ull << bit)))
+        bit++;
+      if (memcmp(set->simd_names + (i + bit) * MICRO_FLAG_SIMD_WIDTH,
+                 token, MICRO_FLAG_SIMD_WIDTH) == 0)
+        return set->simd_flags[i + bit];
+    }
+  }
+  return -1;
+}
+
+// True if the eight bytes of [v] are all ascii digits
+static bool micro_flag_is_8_digits(unsigned long long v)
+{
+  return ((v & 0xF0F0F0F0F0F0F0F0ull)
+          | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+    == 0x3333333333333333ull;
+}
+
+// Value of the eight ascii digits of [v], loaded in little endian
+// order, combining pairs of digits, then pairs of pairs
+static unsigned long long micro_flag_parse_8_digits(unsigned long long v)
+{
+  v = ((v & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+  v = ((v & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+  return ((v & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+}
+
+MicroFlagError micro_flag_parse_int(const char *str,
+                                    size_t len,
+                                    int *out)
+{
+  size_t i = 0;
+  bool negative = false;
+  if (len > 0 && (str[0] == '-' || str[0] == '+'))
+  {
+    negative = (str[0] == '-');
+    i++;
+  }
+  if (i == len)
+    return MICRO_FLAG_ERROR_NOT_AN_INT;
+
+  // Leading zeros do not count towards the digits of an int
+  while (i < len && str[i] == '0')
+    i++;
+  if (len - i > 10)
+    return MICRO_FLAG_ERROR_NOT_AN_INT;
+
+  unsigned long long magnitude = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; len - i >= 8; i += 8)
+  {
+    unsigned long long v;
+    memcpy(&v, str + i, 8);
+    if (!micro_flag_is_8_digits(v))
+      return MICRO_FLAG_ERROR_NOT_AN_INT;
+    magnitude = magnitude * 100000000 + micro_flag_parse_8_digits(v);
+  }
+#endif
+  for (; i < len; ++i)
+  {
+    unsigned int digit = (unsigned int) (str[i] - '0');
+    if (digit > 9)
+      return MICRO_FLAG_ERROR_NOT_AN_INT;
+    magnitude = magnitude * 10 + digit;
+  }
+
+  if (magnitude > (negative ? (unsigned long long) INT_MAX + 1 : INT_MAX))
+    return MICRO_FLAG_ERROR_NOT_AN_INT;
+  *out = negative ? (int) -(long long) magnitude : (int) magnitude;
+  return MICRO_FLAG_OK;
+}
+
+// Digits kept by the decimal fallback of micro_flag_parse_double,
+// enough to round any double correctly
+#define MICRO_FLAG_DECIMAL_DIGITS 800
+
+// Arbitrary precision decimal 0.d[0]d[1]...d[nd-1] * 10^dp, used
+// for the inputs that the fast path cannot convert exactly
+typedef struct {
+  unsigned char d[MICRO_FLAG_DECIMAL_DIGITS];
+  int nd;
+  int dp;
+  // Non zero digits were dropped after d[nd-1]
+  bool trunc;
+} MicroFlagDecimal;
+
+static void micro_flag_decimal_trim(MicroFlagDecimal *a)
+{
+  while (a->nd > 0 && a->d[a->nd - 1] == 0)
+    a->nd--;
+  if (a->nd == 0)
+    a->dp = 0;
+}
+
+// Divide [a] by 2^k, with k at most 60
+static void micro_flag_decimal_rshift(MicroFlagDecimal *a, unsigned int k)
+{
+  int r = 0, w = 0;
+  unsigned long long n = 0;
+  for (; (n >> k) == 0; r++)
+  {
+    if (r >= a->nd)
+    {
+      if (n == 0)
+      {
+        a->nd = 0;
+        return;
+      }
+      while ((n >> k) == 0)
+      {
+        n *= 10;
+        r++;
+      }
+      break;
+    }
+    n = n * 10 + a->d[r];
+  }
+  a->dp -= r - 1;
+
+  unsigned long long mask = (1ull << k) - 1;
+  for (; r < a->nd; r++)
+  {
+    a->d[w++] = (unsigned char) (n >> k);
+    n = (n & mask) * 10 + a->d[r];
+  }
+  while (n > 0)
+  {
+    unsigned char digit = (unsigned char) (n >> k);
+    n &= mask;
+    if (w < MICRO_FLAG_DECIMAL_DIGITS)
+      a->d[w++] = digit;
+    else if (digit > 0)
+      a->trunc = true;
+    n *= 10;
+  }
+
+  a->nd = w;
+  micro_flag_decimal_trim(a);
+}
+
+// Multiply [a] by 2^k, with k at most 60
+static void micro_flag_decimal_lshift(MicroFlagDecimal *a, unsigned int k)
+{
+  // The product is written backwards from the least significant digit
+  unsigned char tmp[MICRO_FLAG_DECIMAL_DIGITS + 20];
+  int w = (int) sizeof(tmp);
+  unsigned long long n = 0;
+  for (int r = a->nd - 1; r >= 0; r--)
+  {
+    n += (unsigned long long) a->d[r] << k;
+    tmp[--w] = (unsigned char) (n % 10);
+    n /= 10;
+  }
+  while (n > 0)
+  {
+    tmp[--w] = (unsigned char) (n % 10);
+    n /= 10;
+  }
+
+  int count = (int) sizeof(tmp) - w;
+  a->dp += count - a->nd;
+  if (count > MICRO_FLAG_DECIMAL_DIGITS)
+  {
+    for (int i = MICRO_FLAG_DECIMAL_DIGITS; i < count; ++i)
+      if (tmp[w + i] != 0)
+        a->trunc = true;
+    count = MICRO_FLAG_DECIMAL_DIGITS;
+  }
+  memcpy(a->d, tmp + w, (size_t) count);
+  a->nd = count;
+  micro_flag_decimal_trim(a);
+}
+
+// Multiply [a] by 2^k, k can be negative
+static void micro_flag_decimal_shift(MicroFlagDecimal *a, int k)
+{
+  if (a->nd == 0)
+    return;
+  for (; k > 60; k -= 60)
+    micro_flag_decimal_lshift(a, 60);
+  for (; k < -60; k += 60)
+    micro_flag_decimal_rshift(a, 60);
+  if (k > 0)
+    micro_flag_decimal_lshift(a, (unsigned int) k);
+  else if (k < 0)
+    micro_flag_decimal_rshift(a, (unsigned int) -k);
+}
+
+// Integer part of [a], rounded half to even
+static unsigned long long micro_flag_decimal_round(const MicroFlagDecimal *a)
+{
+  if (a->dp > 20)
+    return 0xFFFFFFFFFFFFFFFFull;
+
+  int i = 0;
+  unsigned long long n = 0;
+  for (; i < a->dp && i < a->nd; i++)
+    n = n * 10 + a->d[i];
+  for (; i < a->dp; i++)
+    n *= 10;
+
+  int nd = a->dp;
+  if (nd >= 0 && nd < a->nd)
+  {
+    bool round_up;
+    if (a->d[nd] == 5 && nd + 1 == a->nd)
+      round_up = a->trunc || (nd > 0 && a->d[nd - 1] % 2 == 1);
+    else
+      round_up = a->d[nd] >= 5;
+    if (round_up)
+      n++;
+  }
+  return n;
+}
+
+// Bits of the double with [mantissa] and biased [exp]
+static double micro_flag_make_double(bool negative,
+                                     unsigned long long mantissa,
+                                     int exp)
+{
+  unsigned long long bits = mantissa & ((1ull << 52) - 1);
+  bits |= (unsigned long long) (exp & 0x7FF) << 52;
+  if (negative)
+    bits |= 1ull << 63;
+  double val;
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+// Correctly rounded conversion of [a], scaling it by powers of two
+// until it is in [0.5, 1) and taking the top 53 bits
+//
+// Returns: false if the value overflows a double
+static bool micro_flag_decimal_to_double(MicroFlagDecimal *a,
+                                         bool negative,
+                                         double *out)
+{
+  static const int powtab[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+  const int bias = -1023;
+
+  if (a->nd == 0 || a->dp < -330)
+  {
+    *out = micro_flag_make_double(negative, 0, 0);
+    return true;
+  }
+  if (a->dp > 310)
+    return false;
+
+  int exp = 0;
+  while (a->dp > 0)
+  {
+    int n = (a->dp >= 9) ? 27 : powtab[a->dp];
+    micro_flag_decimal_shift(a, -n);
+    exp += n;
+  }
+  while (a->nd > 0 && (a->dp < 0 || (a->dp == 0 && a->d[0] < 5)))
+  {
+    int n = (-a->dp >= 9) ? 27 : powtab[-a->dp];
+    micro_flag_decimal_shift(a, n);
+    exp -= n;
+  }
+
+  // The range is [0.5, 1) but doubles are in [1, 2)
+  exp--;
+  // Denormals
+  if (exp < bias + 1)
+  {
+    int n = bias + 1 - exp;
+    micro_flag_decimal_shift(a, -n);
+    exp += n;
+  }
+  if (exp - bias >= 0x7FF)
+    return false;
+
+  micro_flag_decimal_shift(a, 53);
+  unsigned long long mantissa = micro_flag_decimal_round(a);
+  // Rounding carried into a new bit
+  if (mantissa == (2ull << 52))
+  {
+    mantissa >>= 1;
+    exp++;
+    if (exp - bias >= 0x7FF)
+      return false;
+  }
+  if ((mantissa & (1ull << 52)) == 0)
+    exp = bias;
+
+  *out = micro_flag_make_double(negative, mantissa, exp - bias);
+  return true;
+}
+
+static bool micro_flag_is_word(const char *str, size_t len, const char *word)
+{
+  size_t i = 0;
+  for (; i < len && word[i] != '\0'; ++i)
+    if ((str[i] | 0x20) != word[i])
+      return false;
+  return i == len && word[i] == '\0';
+}
+
+MicroFlagError micro_flag_parse_double(const char *str,
+                                       size_t len,
+                                       double *out)
+{
+  size_t i = 0;
+  bool negative = false;
+  if (len > 0 && (str[0] == '-' || str[0] == '+'))
+  {
+    negative = (str[0] == '-');
+    i++;
+  }
+
+  if (micro_flag_is_word(str + i, len - i, "inf")
+      || micro_flag_is_word(str + i, len - i, "infinity"))
+  {
+    *out = micro_flag_make_double(negative, 0, 0x7FF);
+    return MICRO_FLAG_OK;
+  }
+  if (micro_flag_is_word(str + i, len - i, "nan"))
+  {
+    *out = micro_flag_make_double(negative, 1ull << 51, 0x7FF);
+    return MICRO_FLAG_OK;
+  }
+
+  const char *int_digits = str + i;
+  size_t int_len = 0;
+  while (i < len && str[i] >= '0' && str[i] <= '9')
+  {
+    i++;
+    int_len++;
+  }
+  const char *frac_digits = str + i;
+  size_t frac_len = 0;
+  if (i < len && str[i] == '.')
+  {
+    frac_digits = str + ++i;
+    while (i < len && str[i] >= '0' && str[i] <= '9')
+    {
+      i++;
+      frac_len++;
+    }
+  }
+  if (int_len + frac_len == 0)
+    return MICRO_FLAG_ERROR_NOT_A_DOUBLE;
+
+  int exp10 = 0;
+  if (i < len && (str[i] == 'e' || str[i] == 'E'))
+  {
+    bool exp_negative = false;
+    i++;
+    if (i < len && (str[i] == '-' || str[i] == '+'))
+      exp_negative = (str[i++] == '-');
+    if (i == len)
+      return MICRO_FLAG_ERROR_NOT_A_DOUBLE;
+    for (; i < len && str[i] >= '0' && str[i] <= '9'; ++i)
+      if (exp10 < 100000)
+        exp10 = exp10 * 10 + (str[i] - '0');
+    if (exp_negative)
+      exp10 = -exp10;
+  }
+  if (i != len)
+    return MICRO_FLAG_ERROR_NOT_A_DOUBLE;
+
+  // Significant digits, without the leading zeros
+  unsigned long long mantissa = 0;
+  int num_digits = 0;
+  for (size_t d = 0; d < int_len + frac_len; ++d)
+  {
+    char c = (d < int_len) ? int_digits[d] : frac_digits[d - int_len];
+    if (num_digits == 0 && c == '0')
+      continue;
+    if (++num_digits <= 19)
+      mantissa = mantissa * 10 + (unsigned long long) (c - '0');
+  }
+
+#if FLT_EVAL_METHOD == 0
+  // Clinger's fast path: both the mantissa and the power of ten are
+  // exact doubles, so a single multiplication or division is
+  // correctly rounded
+  static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  const unsigned long long max_exact = 1ull << 53;
+  int e = exp10 - (int) frac_len;
+  if (num_digits <= 19 && mantissa <= max_exact)
+  {
+    if (mantissa == 0)
+    {
+      *out = micro_flag_make_double(negative, 0, 0);
+      return MICRO_FLAG_OK;
+    }
+    // Move the extra powers of ten into the mantissa if it stays exact
+    for (; e > 22 && mantissa <= max_exact / 10; e--)
+      mantissa *= 10;
+    if (e >= -22 && e <= 22)
+    {
+      double val = (double) mantissa;
+      val = (e < 0) ? val / pow10[-e] : val * pow10[e];
+      *out = negative ? -val : val;
+      return MICRO_FLAG_OK;
+    }
+  }
+#endif
+
+  MicroFlagDecimal dec;
+  dec.nd = 0;
+  dec.dp = 0;
+  dec.trunc = false;
+  for (size_t d = 0; d < int_len + frac_len; ++d)
+  {
+    bool is_int = (d < int_len);
+    unsigned char digit = (unsigned char)
+      ((is_int ? int_digits[d] : frac_digits[d - int_len]) - '0');
+    if (dec.nd == 0 && digit == 0)
+    {
+      // Leading zeros after the point move the point
+      if (!is_int)
+        dec.dp--;
+      continue;
+    }
+    if (is_int)
+      dec.dp++;
+    if (dec.nd < MICRO_FLAG_DECIMAL_DIGITS)
+      dec.d[dec.nd++] = digit;
+    else if (digit != 0)
+      dec.trunc = true;
+  }
+  dec.dp += exp10;
+  micro_flag_decimal_trim(&dec);
+
+  if (!micro_flag_decimal_to_double(&dec, negative, out))
+    return MICRO_FLAG_ERROR_NOT_A_DOUBLE;
+  return MICRO_FLAG_OK;
+}
+
+// Address of the value of [flag], relative to [base] in offset tables
+static void *micro_flag_target(const MicroFlag *flag, void *base)
+{
+  if (base == NULL)
+    return flag->value;
+  return (char*) base + (size_t) flag->value;
+}
+
+// Convert [value] and store it at [target], the value of [flag].
+// [value] is not copied, string flags point to it
+static MicroFlagError micro_flag_set_value(const MicroFlag *flag,
+                                           void *target,
+                                           char *value)
+{
+  switch (flag->type)
+  {
+  case MICRO_FLAG_BOOL:
+    *((bool*) target) = true;
+    break;
+  case MICRO_FLAG_CHAR:
+    if (value[0] == '\0' || value[1] != '\0')
+      return MICRO_FLAG_ERROR_CHAR_WRONG_ARG;
+    *((char*) target) = *value;
+    break;
+  case MICRO_FLAG_STR:
+    *((char**) target) = value;
+    break;
+  case MICRO_FLAG_INT:
+    return micro_flag_parse_int(value, strlen(value), (int*) target);
+  case MICRO_FLAG_DOUBLE:
+    return micro_flag_parse_double(value, strlen(value), (double*) target);
+#ifdef MICRO_FLAG_ATOMICS
+  case MICRO_FLAG_ATOMIC_INT:
+  {
+    int v;
+    MicroFlagError err = micro_flag_parse_int(value, strlen(value), &v);
+    if (err == MICRO_FLAG_OK)
+      __atomic_store_n((int*) target, v, __ATOMIC_RELAXED);
+    return err;
+  }
+  case MICRO_FLAG_ATOMIC_DOUBLE:
+  {
+    double v;
+    MicroFlagError err = micro_flag_parse_double(value, strlen(value), &v);
+    if (err == MICRO_FLAG_OK)
+      __atomic_store((double*) target, &v, __ATOMIC_RELAXED);
+    return err;
+  }
+  case MICRO_FLAG_ATOMIC_STR:
+    __atomic_store_n((char**) target, value, __ATOMIC_RELEASE);
+    break;
+#endif
+  default:
+    return MICRO_FLAG_ERROR_UNKNOWN_TYPE;
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+static MicroFlagError micro_flag_missing_error(MicroFlagType type)
+{
+  switch (type)
+  {
+  case MICRO_FLAG_CHAR:   return MICRO_FLAG_ERROR_MISSING_CHAR;
+  case MICRO_FLAG_STR:    return MICRO_FLAG_ERROR_MISSING_STR;
+  case MICRO_FLAG_INT:    return MICRO_FLAG_ERROR_MISSING_INT;
+  case MICRO_FLAG_DOUBLE: return MICRO_FLAG_ERROR_MISSING_DOUBLE;
+  case MICRO_FLAG_ATOMIC_INT:    return MICRO_FLAG_ERROR_MISSING_INT;
+  case MICRO_FLAG_ATOMIC_DOUBLE: return MICRO_FLAG_ERROR_MISSING_DOUBLE;
+  case MICRO_FLAG_ATOMIC_STR:    return MICRO_FLAG_ERROR_MISSING_STR;
+  default:                return MICRO_FLAG_ERROR_UNKNOWN_TYPE;
+  }
+}
+
+static bool micro_flag_is_short(const char *arg)
+{
+  return arg[0] == '-' && arg[1] != '\0' && arg[1] != '-';
+}
+
+static MicroFlagError micro_flag_fail(MicroFlagContext *ctx,
+                                      MicroFlagError error,
+                                      int index,
+                                      const char *arg,
+                                      const MicroFlag *flag)
+{
+  ctx->diag.error = error;
+  ctx->diag.index = index;
+  ctx->diag.arg   = arg;
+  ctx->diag.flag  = flag;
+  return error;
+}
+
+void micro_flag_context_init(MicroFlagContext *ctx, void *base)
+{
+  micro_flag_fail(ctx, MICRO_FLAG_OK, -1, NULL, NULL);
+  ctx->base          = base;
+  ctx->pending       = NULL;
+  ctx->pending_arg   = NULL;
+  ctx->pending_index = -1;
+  ctx->index         = 0;
+  ctx->ignore_unknown = false;
+  ctx->response_files = false;
+  ctx->files         = NULL;
+  ctx->copy_files    = false;
+  ctx->strings       = NULL;
+  ctx->strings_cap   = 0;
+  ctx->strings_len   = 0;
+  ctx->lazy          = NULL;
+  ctx->num_lazy      = 0;
+}
+
+void micro_flag_context_strings(MicroFlagContext *ctx,
+                                char *strings,
+                                size_t cap)
+{
+  ctx->strings     = strings;
+  ctx->strings_cap = cap;
+  ctx->strings_len = 0;
+}
+
+// Reset the state of a parse, but not its options nor the values
+// recorded in lazy slots, which later sources override
+static void micro_flag_context_reset(MicroFlagContext *ctx)
+{
+  micro_flag_fail(ctx, MICRO_FLAG_OK, -1, NULL, NULL);
+  ctx->pending       = NULL;
+  ctx->pending_arg   = NULL;
+  ctx->pending_index = -1;
+  ctx->index         = 0;
+}
+
+static bool micro_flag_is_lazy(MicroFlagType type)
+{
+  return type == MICRO_FLAG_CHAR || type == MICRO_FLAG_INT
+    || type == MICRO_FLAG_DOUBLE;
+}
+
+// Store [value] in [flag] of [set], copying strings to the string
+// pool of [ctx] if it has one, or only record it in lazy parses.
+// [arg] and [index] are reported on error
+static MicroFlagError micro_flag_store(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       const MicroFlag *flag,
+                                       int index,
+                                       const char *arg,
+                                       char *value)
+{
+  bool lazy = ctx->lazy != NULL && micro_flag_is_lazy(flag->type);
+  if ((lazy || flag->type == MICRO_FLAG_STR || flag->type == MICRO_FLAG_ATOMIC_STR)
+      && ctx->strings != NULL)
+  {
+    size_t len = strlen(value) + 1;
+    if (ctx->strings_cap - ctx->strings_len < len)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_NO_SPACE, index, arg, flag);
+    value = (char*) memcpy(ctx->strings + ctx->strings_len, value, len);
+    ctx->strings_len += len;
+  }
+
+  if (lazy)
+  {
+    MicroFlagLazy *slot = &ctx->lazy[flag - set->flags];
+    slot->raw       = value;
+    slot->arg       = arg;
+    slot->index     = index;
+    slot->converted = false;
+    return MICRO_FLAG_OK;
+  }
+
+  MicroFlagError err =
+    micro_flag_set_value(flag, micro_flag_target(flag, ctx->base), value);
+  if (err != MICRO_FLAG_OK)
+    return micro_flag_fail(ctx, err, index, arg, flag);
+  return MICRO_FLAG_OK;
+}
+
+void micro_flag_context_lazy(MicroFlagContext *ctx,
+                             MicroFlagLazy *lazy,
+                             unsigned int num_flags)
+{
+  memset(lazy, 0, num_flags * sizeof(MicroFlagLazy));
+  ctx->lazy     = lazy;
+  ctx->num_lazy = num_flags;
+}
+
+void micro_flag_context_clear_lazy(MicroFlagContext *ctx)
+{
+  if (ctx->lazy != NULL)
+    memset(ctx->lazy, 0, ctx->num_lazy * sizeof(MicroFlagLazy));
+}
+
+// Find the flag [name] of [type] for a micro_flag_get_*, converting
+// its value on the first access of a lazy parse
+//
+// Returns: MICRO_FLAG_OK and the address of the value in [target],
+// or an error
+static MicroFlagError micro_flag_get(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     const char *name,
+                                     MicroFlagType type,
+                                     void **target)
+{
+  int flag = micro_flag_lookup(set, name, strlen(name));
+  if (flag == -1)
+    return MICRO_FLAG_ERROR_UNKNOWN_FLAG;
+  if (flag == -2)
+    return MICRO_FLAG_ERROR_AMBIGUOUS_FLAG;
+  const MicroFlag *f = &set->flags[flag];
+  if (f->type != type)
+    return MICRO_FLAG_ERROR_UNKNOWN_TYPE;
+
+  *target = micro_flag_target(f, ctx->base);
+  if (ctx->lazy == NULL)
+    return MICRO_FLAG_OK;
+
+  MicroFlagLazy *slot = &ctx->lazy[flag];
+  if (slot->raw == NULL)
+    return MICRO_FLAG_OK;
+  if (!slot->converted)
+  {
+    slot->error = micro_flag_set_value(f, *target, (char*) slot->raw);
+    slot->converted = true;
+  }
+  if (slot->error != MICRO_FLAG_OK)
+    return micro_flag_fail(ctx, slot->error, slot->index, slot->arg, f);
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_get_int(const MicroFlagSet *set,
+                                  MicroFlagContext *ctx,
+                                  const char *name,
+                                  int *out)
+{
+  void *target;
+  MicroFlagError err = micro_flag_get(set, ctx, name, MICRO_FLAG_INT, &target);
+  if (err == MICRO_FLAG_OK)
+    *out = *(int*) target;
+  return err;
+}
+
+MicroFlagError micro_flag_get_double(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     const char *name,
+                                     double *out)
+{
+  void *target;
+  MicroFlagError err = micro_flag_get(set, ctx, name, MICRO_FLAG_DOUBLE, &target);
+  if (err == MICRO_FLAG_OK)
+    *out = *(double*) target;
+  return err;
+}
+
+MicroFlagError micro_flag_get_char(const MicroFlagSet *set,
+                                   MicroFlagContext *ctx,
+                                   const char *name,
+                                   char *out)
+{
+  void *target;
+  MicroFlagError err = micro_flag_get(set, ctx, name, MICRO_FLAG_CHAR, &target);
+  if (err == MICRO_FLAG_OK)
+    *out = *(char*) target;
+  return err;
+}
+
+// Find the first [a] or [b] from [p] up to [end]
+//
+// Returns: a pointer to it, or [end] if there is none
+typedef const char *(*MicroFlagScanFn)(const char *p,
+                                       const char *end,
+                                       char a,
+                                       char b);
+
+static const char *micro_flag_scan_scalar(const char *p,
+                                          const char *end,
+                                          char a,
+                                          char b)
+{
+  while (p < end && *p != a && *p != b)
+    ++p;
+  return p;
+}
+
+#ifdef MICRO_FLAG_SSE2
+
+static const char *micro_flag_scan_sse2(const char *p,
+                                        const char *end,
+                                        char a,
+                                        char b)
+{
+  __m128i va = _mm_set1_epi8(a);
+  __m128i vb = _mm_set1_epi8(b);
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va),
+                                              _mm_cmpeq_epi8(chunk, vb)));
+    if (mask != 0)
+      return p + __builtin_ctz((unsigned int) mask);
+  }
+  return micro_flag_scan_scalar(p, end, a, b);
+}
+
+#endif // MICRO_FLAG_SSE2
+
+// The scan for the target, chosen at compile time so that parses do
+// not query the CPU
+static MicroFlagScanFn micro_flag_scan_select(void)
+{
+#ifdef MICRO_FLAG_SSE2
+  return micro_flag_scan_sse2;
+#else
+  return micro_flag_scan_scalar;
+#endif
+}
+
+// The bytes of the default IFS of the POSIX shell
+static bool micro_flag_is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Find the end of the unquoted part of a word from [p] up to [end]
+//
+// Returns: a pointer to the first space, tab, newline, quote, backslash or
+// null byte, or [end] if there is none
+typedef const char *(*MicroFlagSpanFn)(const char *p, const char *end);
+
+static const char *micro_flag_span_scalar(const char *p, const char *end)
+{
+  while (p < end && *p != '\0' && !micro_flag_is_space(*p)
+         && *p != '\'' && *p != '"' && *p != '\\')
+    ++p;
+  return p;
+}
+
+#ifdef MICRO_FLAG_SSE2
+
+static const char *micro_flag_span_sse2(const char *p, const char *end)
+{
+  const __m128i tab    = _mm_set1_epi8('\t');
+  const __m128i nl     = _mm_set1_epi8('\n');
+  const __m128i space  = _mm_set1_epi8(' ');
+  const __m128i single = _mm_set1_epi8('\'');
+  const __m128i dbl    = _mm_set1_epi8('"');
+  const __m128i slash  = _mm_set1_epi8('\\');
+  const __m128i zero   = _mm_setzero_si128();
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i c = _mm_loadu_si128((const __m128i*) p);
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(c, tab), _mm_cmpeq_epi8(c, nl));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, space));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, single));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, dbl));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, slash));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, zero));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0)
+      return p + __builtin_ctz((unsigned int) mask);
+  }
+  return micro_flag_span_scalar(p, end);
+}
+
+#endif // MICRO_FLAG_SSE2
+
+// The span for the target, chosen at compile time like the scan
+static MicroFlagSpanFn micro_flag_span_select(void)
+{
+#ifdef MICRO_FLAG_SSE2
+  return micro_flag_span_sse2;
+#else
+  return micro_flag_span_scalar;
+#endif
+}
+
+// Split the [len] bytes of [data] in words with the rules of the
+// POSIX shell and feed them, in place. Words are separated by spaces,
+// tabs and newlines; single quotes keep everything literally, double
+// quotes keep everything but backslash escapes of $ ` " \ and a
+// backslash escapes the next byte outside them. A backslash before a
+// newline joins lines. There are no expansions. If [skip_first], the
+// first word is the program name and is not fed. [data] must have a
+// writable byte at [len]
+static MicroFlagError micro_flag_feed_words(const MicroFlagSet *set,
+                                            MicroFlagContext *ctx,
+                                            char *data,
+                                            size_t len,
+                                            bool skip_first)
+{
+  MicroFlagSpanFn span = micro_flag_span_select();
+  MicroFlagScanFn scan = micro_flag_scan_select();
+  char *r = data, *end = data + len;
+  *end = '\0';
+
+  while (r < end)
+  {
+    if (*r == '\0' || micro_flag_is_space(*r))
+    {
+      ++r;
+      continue;
+    }
+
+    // Quotes and escapes are removed by moving the rest of the word
+    // back, [w] is where the next byte of the word goes. Spans
+    // without special bytes are found and moved in bulk
+    char *word = r, *w = r;
+    char quote = 0;
+    bool quoted = false;
+    while (r < end)
+    {
+      const char *stop;
+      if (quote == 0)
+        stop = span(r, end);
+      else
+        stop = scan(r, end, quote, quote == '"' ? '\\' : quote);
+      size_t n = (size_t) (stop - r);
+      if (w != r)
+        memmove(w, r, n);
+      w += n;
+      r += n;
+      if (r == end || (quote == 0 && (*r == '\0' || micro_flag_is_space(*r))))
+        break;
+
+      if (*r == quote)
+      {
+        quote = 0;
+        ++r;
+      }
+      else if (*r == '\\')
+      {
+        if (r + 1 < end && r[1] == '\n')
+          r += 2;
+        else if (r + 1 == end || (quote == '"' && !memchr("$`\"\\", r[1], 4)))
+          *w++ = *r++;
+        else
+        {
+          *w++ = r[1];
+          r += 2;
+        }
+      }
+      else
+      {
+        quote = *r++;
+        quoted = true;
+      }
+    }
+    if (quote != 0)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_UNTERMINATED,
+                             ctx->index + 1, word, NULL);
+
+    // The separator may be overwritten by the terminator
+    char *next = r < end ? r + 1 : end;
+    *w = '\0';
+    r = next;
+    // Only joined lines, not a word
+    if (w == word && !quoted)
+      continue;
+    if (skip_first)
+    {
+      skip_first = false;
+      continue;
+    }
+    MicroFlagError err = micro_flag_feed(set, ctx, word);
+    if (err != MICRO_FLAG_OK)
+      return err;
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_parse_string(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       char *str)
+{
+  micro_flag_context_reset(ctx);
+  MicroFlagError err = micro_flag_feed_words(set, ctx, str, strlen(str), true);
+  if (err != MICRO_FLAG_OK)
+    return err;
+  return micro_flag_finish(set, ctx);
+}
+
+MicroFlagError micro_flag_parse_string_copy(const MicroFlagSet *set,
+                                            MicroFlagContext *ctx,
+                                            const char *str,
+                                            char *arena,
+                                            size_t cap)
+{
+  // Words are never longer than the string they come from
+  size_t len = strlen(str);
+  if (len >= cap)
+  {
+    micro_flag_context_reset(ctx);
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_NO_SPACE, 0, str, NULL);
+  }
+  memcpy(arena, str, len + 1);
+  return micro_flag_parse_string(set, ctx, arena);
+}
+
+// Parse a config value for a boolean flag
+//
+// Returns: MICRO_FLAG_OK on success, or MICRO_FLAG_ERROR_NOT_A_BOOL
+static MicroFlagError micro_flag_parse_bool(const char *str, bool *out)
+{
+  static const char *names[] =
+    { "true", "yes", "on", "1", "false", "no", "off", "0" };
+  for (int i = 0; i < 8; ++i)
+  {
+    if (strcmp(str, names[i]) == 0)
+    {
+      *out = i < 4;
+      return MICRO_FLAG_OK;
+    }
+  }
+  return MICRO_FLAG_ERROR_NOT_A_BOOL;
+}
+
+// Find the flag named exactly [name] of [len] bytes with the index of
+// [set], ignoring the abbreviations of micro_flag_compile_trie. Config
+// files and the environment outlive the table they were written for,
+// where an abbreviation would silently change meaning as flags are
+// added
+//
+// Returns: the index of the flag, or -1 if there is none
+static int micro_flag_lookup_exact(const MicroFlagSet *set,
+                                   const char *name,
+                                   size_t len)
+{
+  return set->index_lookup(set, name, len);
+}
+
+MicroFlagError micro_flag_parse_env(const MicroFlagSet *set,
+                                    MicroFlagContext *ctx,
+                                    const char *prefix,
+                                    char **envp)
+{
+  micro_flag_context_reset(ctx);
+
+  size_t prefix_len = strlen(prefix);
+  // APP_SOME_NAME is looked up as --some-name
+  char name[256] = "--";
+  for (int i = 0; envp[i] != NULL; ++i)
+  {
+    char *var = envp[i];
+    if (strncmp(var, prefix, prefix_len) != 0)
+      continue;
+
+    size_t len = 0;
+    const char *p = var + prefix_len;
+    for (; *p != '=' && *p != '\0' && len + 3 < sizeof(name); ++p, ++len)
+    {
+      char c = *p;
+      if (c >= 'A' && c <= 'Z')
+        c = (char) (c - 'A' + 'a');
+      else if (c == '_')
+        c = '-';
+      name[2 + len] = c;
+    }
+    if (*p != '=' || len == 0)
+      continue;
+    name[2 + len] = '\0';
+
+    int flag = micro_flag_lookup_exact(set, name, len + 2);
+    if (flag < 0)
+      continue;
+
+    const MicroFlag *f = &set->flags[flag];
+    char *value = (char*) p + 1;
+    MicroFlagError err;
+    if (f->type == MICRO_FLAG_BOOL)
+    {
+      err = micro_flag_parse_bool(value, (bool*) micro_flag_target(f, ctx->base));
+      if (err != MICRO_FLAG_OK)
+        return micro_flag_fail(ctx, err, i, var, f);
+    }
+    else if ((err = micro_flag_store(set, ctx, f, i, var, value)) != MICRO_FLAG_OK)
+    {
+      return err;
+    }
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+#ifdef MICRO_FLAG_POSIX
+
+// Load the file at [path] in a new entry of ctx->files, with its
+// [size] bytes followed by a null byte. If [cycle], a file that is
+// already open is an include cycle
+static MicroFlagError micro_flag_load_file(MicroFlagContext *ctx,
+                                           const char *path,
+                                           bool cycle,
+                                           MicroFlagFile **out,
+                                           size_t *out_size)
+{
+  int fd;
+  do
+    fd = open(path, O_RDONLY);
+  while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return MICRO_FLAG_ERROR_IO;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return MICRO_FLAG_ERROR_IO;
+  }
+  for (MicroFlagFile *f = ctx->files; cycle && f != NULL; f = f->next)
+  {
+    if (f->open && f->dev == (unsigned long long) st.st_dev
+        && f->ino == (unsigned long long) st.st_ino)
+    {
+      close(fd);
+      return MICRO_FLAG_ERROR_INCLUDE_CYCLE;
+    }
+  }
+
+  MicroFlagFile *file = (MicroFlagFile*) malloc(sizeof(MicroFlagFile));
+  if (file == NULL)
+  {
+    close(fd);
+    return MICRO_FLAG_ERROR_ALLOC;
+  }
+  file->data   = NULL;
+  file->mapped = 0;
+  file->dev    = (unsigned long long) st.st_dev;
+  file->ino    = (unsigned long long) st.st_ino;
+  file->open   = false;
+
+  // Map the file privately, so that changes in place only copy the
+  // pages they are in. The byte after the end is in the zero filled
+  // tail of the last page, unless the size is a multiple of the page
+  // size: then the file is read instead
+  size_t size = (size_t) st.st_size;
+  long page = sysconf(_SC_PAGESIZE);
+  if (!ctx->copy_files && size > 0 && page > 0 && size % (size_t) page != 0)
+  {
+    void *p = mmap(NULL, size + 1, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      file->data   = (char*) p;
+      file->mapped = size + 1;
+    }
+  }
+  if (file->data == NULL)
+  {
+    file->data = (char*) malloc(size + 1);
+    size_t done = 0;
+    while (file->data != NULL && done < size)
+    {
+      ssize_t r = read(fd, file->data + done, size - done);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        break;
+      done += (size_t) r;
+    }
+    size = done;
+  }
+  close(fd);
+  if (file->data == NULL)
+  {
+    free(file);
+    return MICRO_FLAG_ERROR_ALLOC;
+  }
+  file->data[size] = '\0';
+
+  file->next = ctx->files;
+  ctx->files = file;
+  *out       = file;
+  *out_size  = size;
+  return MICRO_FLAG_OK;
+}
+
+// Feed the arguments in the response file named by [arg], "@path"
+static MicroFlagError micro_flag_feed_file(const MicroFlagSet *set,
+                                           MicroFlagContext *ctx,
+                                           const char *arg)
+{
+  int index = ctx->index;
+  MicroFlagFile *file;
+  size_t size;
+  MicroFlagError err = micro_flag_load_file(ctx, arg + 1, true, &file, &size);
+  if (err != MICRO_FLAG_OK)
+    return micro_flag_fail(ctx, err, index, arg, NULL);
+
+  // The words of the file do not count as arguments: errors in them,
+  // and a flag at its end waiting for its value, are reported at the
+  // index of the "@path" argument
+  file->open = true;
+  err = micro_flag_feed_words(set, ctx, file->data, size, false);
+  file->open = false;
+  ctx->index = index;
+  if (ctx->pending != NULL && ctx->pending_index > index)
+    ctx->pending_index = index;
+  if (err != MICRO_FLAG_OK)
+    ctx->diag.index = index;
+  return err;
+}
+
+// Blanks trimmed around keys and values of config files, which also
+// covers the '\r' of files with CRLF line ends
+static bool micro_flag_is_blank(char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+MicroFlagError micro_flag_parse_config(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       const char *path)
+{
+  micro_flag_context_reset(ctx);
+
+  MicroFlagFile *file;
+  size_t size;
+  MicroFlagError err = micro_flag_load_file(ctx, path, false, &file, &size);
+  if (err != MICRO_FLAG_OK)
+    return micro_flag_fail(ctx, err, 0, path, NULL);
+
+  MicroFlagScanFn scan = micro_flag_scan_select();
+  // Keys are looked up as long names, with the dashes in front
+  char name[256] = "--";
+  char *p = file->data, *end = file->data + size;
+  for (int line = 1; p < end; ++line)
+  {
+    char *eq = (char*) scan(p, end, '=', '\n');
+    char *nl = eq;
+    if (eq < end && *eq == '=')
+    {
+      nl = (char*) memchr(eq, '\n', (size_t) (end - eq));
+      if (nl == NULL)
+        nl = end;
+    }
+    char *next = nl < end ? nl + 1 : end;
+
+    char *key = p;
+    while (key < nl && micro_flag_is_blank(*key))
+      ++key;
+    if (key == nl || *key == '#' || *key == ';')
+    {
+      p = next;
+      continue;
+    }
+    if (eq == nl)
+    {
+      while (nl > key && micro_flag_is_blank(nl[-1]))
+        --nl;
+      *nl = '\0';
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_SYNTAX, line, key, NULL);
+    }
+
+    char *key_end = eq;
+    while (key_end > key && micro_flag_is_blank(key_end[-1]))
+      --key_end;
+    char *value = eq + 1;
+    while (value < nl && micro_flag_is_blank(*value))
+      ++value;
+    char *value_end = nl;
+    while (value_end > value && micro_flag_is_blank(value_end[-1]))
+      --value_end;
+    if (value_end - value >= 2 && (*value == '"' || *value == '\'')
+        && value_end[-1] == *value)
+    {
+      ++value;
+      --value_end;
+    }
+    *key_end   = '\0';
+    *value_end = '\0';
+
+    size_t len = (size_t) (key_end - key);
+    int flag = -1;
+    if (len + 2 < sizeof(name))
+    {
+      memcpy(name + 2, key, len);
+      flag = micro_flag_lookup_exact(set, name, len + 2);
+    }
+    if (flag == -1 && !ctx->ignore_unknown)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_UNKNOWN_FLAG, line, key, NULL);
+
+    if (flag >= 0)
+    {
+      const MicroFlag *f = &set->flags[flag];
+      if (f->type == MICRO_FLAG_BOOL)
+      {
+        err = micro_flag_parse_bool(value, (bool*) micro_flag_target(f, ctx->base));
+        if (err != MICRO_FLAG_OK)
+          return micro_flag_fail(ctx, err, line, key, f);
+      }
+      else if ((err = micro_flag_store(set, ctx, f, line, key, value)) != MICRO_FLAG_OK)
+      {
+        return err;
+      }
+    }
+    p = next;
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+#endif // MICRO_FLAG_POSIX
+
+void micro_flag_context_release(MicroFlagContext *ctx)
+{
+  while (ctx->files != NULL)
+  {
+    MicroFlagFile *file = ctx->files;
+    ctx->files = file->next;
+#ifdef MICRO_FLAG_POSIX
+    if (file->mapped > 0)
+      munmap(file->data, file->mapped);
+    else
+#endif
+      free(file->data);
+    free(file);
+  }
+}
+
+// Layout of a cache blob: a header, one record per flag and the pool
+// of the string values. Offsets make it position independent
+typedef struct {
+  char magic[8];
+  unsigned long long schema;
+  unsigned long long key;
+  unsigned long long num_flags;
+  unsigned long long size;
+} MicroFlagCacheHeader;
+
+typedef struct {
+  unsigned long long type;
+  // Integers and bools as they are, doubles by their bits, strings
+  // as one more than their offset in the pool, or 0 for NULL
+  unsigned long long value;
+} MicroFlagCacheRecord;
+
+static const char micro_flag_cache_magic[8] = { 'M', 'F', 'C', 'A', 'C', 'H', 'E', '1' };
+
+static bool micro_flag_is_str(MicroFlagType type)
+{
+  return type == MICRO_FLAG_STR || type == MICRO_FLAG_ATOMIC_STR;
+}
+
+// FNV-1a 64 of the types and names of the flags of [set]
+static unsigned long long micro_flag_schema_hash(const MicroFlagSet *set)
+{
+  unsigned long long hash = 14695981039346656037ull;
+  for (unsigned int i = 0; i < set->num_flags; ++i)
+  {
+    const MicroFlag *f = &set->flags[i];
+    const char *names[2] = { f->short_name, f->long_name };
+    hash = (hash ^ (unsigned long long) f->type) * 1099511628211ull;
+    for (int n = 0; n < 2; ++n)
+    {
+      for (const char *c = names[n]; c != NULL && *c != '\0'; ++c)
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ull;
+      hash = (hash ^ 0xff) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+// The string value of [flag] at [target], loaded with acquire for
+// atomic strings that another thread may be setting
+static const char *micro_flag_cache_str(const MicroFlag *flag, void *target)
+{
+#ifdef MICRO_FLAG_ATOMICS
+  if (flag->type == MICRO_FLAG_ATOMIC_STR)
+    return micro_flag_load_str((char**) target);
+#endif
+  return flag->type == MICRO_FLAG_STR ? *(char**) target : NULL;
+}
+
+MicroFlagError micro_flag_cache_save(const MicroFlagSet *set,
+                                     void *base,
+                                     unsigned long long key,
+                                     void *buf,
+                                     size_t cap,
+                                     size_t *len)
+{
+  size_t records = sizeof(MicroFlagCacheHeader)
+    + set->num_flags * sizeof(MicroFlagCacheRecord);
+  size_t size = records;
+  for (unsigned int i = 0; i < set->num_flags; ++i)
+  {
+    const MicroFlag *f = &set->flags[i];
+    const char *str = micro_flag_cache_str(f, micro_flag_target(f, base));
+    if (str != NULL)
+      size += strlen(str) + 1;
+  }
+  *len = size;
+  if (buf == NULL || cap < size)
+    return MICRO_FLAG_ERROR_NO_SPACE;
+
+  MicroFlagCacheHeader *header = (MicroFlagCacheHeader*) buf;
+  memcpy(header->magic, micro_flag_cache_magic, sizeof(header->magic));
+  header->schema    = micro_flag_schema_hash(set);
+  header->key       = key;
+  header->num_flags = set->num_flags;
+
+  MicroFlagCacheRecord *record = (MicroFlagCacheRecord*) (header + 1);
+  char *pool = (char*) buf + records;
+  size_t pool_len = 0;
+  for (unsigned int i = 0; i < set->num_flags; ++i, ++record)
+  {
+    const MicroFlag *f = &set->flags[i];
+    void *target = micro_flag_target(f, base);
+    record->type  = (unsigned long long) f->type;
+    record->value = 0;
+    switch (f->type)
+    {
+    case MICRO_FLAG_BOOL:
+      record->value = *(bool*) target;
+      break;
+    case MICRO_FLAG_CHAR:
+      record->value = (unsigned char) *(char*) target;
+      break;
+    case MICRO_FLAG_INT:
+      record->value = (unsigned long long) (long long) *(int*) target;
+      break;
+    case MICRO_FLAG_DOUBLE:
+      memcpy(&record->value, target, sizeof(double));
+      break;
+#ifdef MICRO_FLAG_ATOMICS
+    case MICRO_FLAG_ATOMIC_INT:
+      record->value =
+        (unsigned long long) (long long) micro_flag_load_int((int*) target);
+      break;
+    case MICRO_FLAG_ATOMIC_DOUBLE:
+    {
+      double v = micro_flag_load_double((double*) target);
+      memcpy(&record->value, &v, sizeof(double));
+      break;
+    }
+    case MICRO_FLAG_ATOMIC_STR:
+#endif
+    case MICRO_FLAG_STR:
+    {
+      // An atomic string set since it was measured may not fit
+      const char *str = micro_flag_cache_str(f, target);
+      if (str == NULL)
+        break;
+      size_t str_len = strlen(str) + 1;
+      if (str_len > cap - records - pool_len)
+        return MICRO_FLAG_ERROR_NO_SPACE;
+      memcpy(pool + pool_len, str, str_len);
+      record->value = pool_len + 1;
+      pool_len += str_len;
+      break;
+    }
+    default:
+      return MICRO_FLAG_ERROR_UNKNOWN_TYPE;
+    }
+  }
+
+  *len = records + pool_len;
+  header->size = *len;
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_cache_apply(const MicroFlagSet *set,
+                                      MicroFlagContext *ctx,
+                                      unsigned long long key,
+                                      const void *blob,
+                                      size_t len)
+{
+  micro_flag_context_reset(ctx);
+
+  // Check everything before writing any value
+  const MicroFlagCacheHeader *header = (const MicroFlagCacheHeader*) blob;
+  size_t records = sizeof(MicroFlagCacheHeader)
+    + set->num_flags * sizeof(MicroFlagCacheRecord);
+  if (len < sizeof(MicroFlagCacheHeader)
+      || memcmp(header->magic, micro_flag_cache_magic, sizeof(header->magic)) != 0
+      || header->size != len)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_BAD_CACHE, -1, NULL, NULL);
+  if (header->num_flags != set->num_flags
+      || header->schema != micro_flag_schema_hash(set)
+      || header->key != key)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_STALE_CACHE, -1, NULL, NULL);
+  if (len < records)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_BAD_CACHE, -1, NULL, NULL);
+
+  // Strings are inside the pool if it ends with a terminator
+  const MicroFlagCacheRecord *record = (const MicroFlagCacheRecord*) (header + 1);
+  const char *pool = (const char*) blob + records;
+  size_t pool_len = len - records;
+  for (unsigned int i = 0; i < set->num_flags; ++i)
+  {
+    if (record[i].type != (unsigned long long) set->flags[i].type
+        || (micro_flag_is_str(set->flags[i].type) && record[i].value > pool_len)
+        || (micro_flag_is_str(set->flags[i].type) && record[i].value != 0
+            && pool[pool_len - 1] != '\0'))
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_BAD_CACHE, -1, NULL, NULL);
+  }
+
+  for (unsigned int i = 0; i < set->num_flags; ++i, ++record)
+  {
+    const MicroFlag *f = &set->flags[i];
+    void *target = micro_flag_target(f, ctx->base);
+    switch (f->type)
+    {
+    case MICRO_FLAG_BOOL:
+      *(bool*) target = record->value != 0;
+      break;
+    case MICRO_FLAG_CHAR:
+      *(char*) target = (char) record->value;
+      break;
+    case MICRO_FLAG_INT:
+      *(int*) target = (int) (long long) record->value;
+      break;
+    case MICRO_FLAG_DOUBLE:
+      memcpy(target, &record->value, sizeof(double));
+      break;
+    case MICRO_FLAG_STR:
+      *(char**) target = record->value == 0
+        ? NULL : (char*) pool + (record->value - 1);
+      break;
+#ifdef MICRO_FLAG_ATOMICS
+    case MICRO_FLAG_ATOMIC_INT:
+      __atomic_store_n((int*) target, (int) (long long) record->value,
+                       __ATOMIC_RELAXED);
+      break;
+    case MICRO_FLAG_ATOMIC_DOUBLE:
+    {
+      double v;
+      memcpy(&v, &record->value, sizeof(double));
+      __atomic_store((double*) target, &v, __ATOMIC_RELAXED);
+      break;
+    }
+    case MICRO_FLAG_ATOMIC_STR:
+      __atomic_store_n((char**) target, record->value == 0
+                       ? NULL : (char*) pool + (record->value - 1),
+                       __ATOMIC_RELEASE);
+      break;
+#endif
+    default:
+      break;
+    }
+  }
+
+  return MICRO_FLAG_OK;
+}
+
+#ifdef MICRO_FLAG_POSIX
+
+MicroFlagError micro_flag_cache_write(const MicroFlagSet *set,
+                                      void *base,
+                                      unsigned long long key,
+                                      const char *path)
+{
+  size_t len;
+  micro_flag_cache_save(set, base, key, NULL, 0, &len);
+  char *buf = (char*) malloc(len);
+  if (buf == NULL)
+    return MICRO_FLAG_ERROR_ALLOC;
+  MicroFlagError err = micro_flag_cache_save(set, base, key, buf, len, &len);
+  if (err != MICRO_FLAG_OK)
+  {
+    free(buf);
+    return err;
+  }
+
+  // Write a new file and rename it over the old one, so that the
+  // mappings of the old file stay valid
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid())
+      >= (int) sizeof(tmp))
+  {
+    free(buf);
+    return MICRO_FLAG_ERROR_IO;
+  }
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    free(buf);
+    return MICRO_FLAG_ERROR_IO;
+  }
+  size_t done = 0;
+  while (done < len)
+  {
+    ssize_t w = write(fd, buf + done, len - done);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      break;
+    done += (size_t) w;
+  }
+  free(buf);
+  if (close(fd) != 0 || done < len || rename(tmp, path) != 0)
+  {
+    unlink(tmp);
+    return MICRO_FLAG_ERROR_IO;
+  }
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_cache_load(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     unsigned long long key,
+                                     const char *path)
+{
+  micro_flag_context_reset(ctx);
+
+  int fd;
+  do
+    fd = open(path, O_RDONLY);
+  while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_IO, -1, path, NULL);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_BAD_CACHE, -1, path, NULL);
+  }
+
+  size_t size = (size_t) st.st_size;
+  void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_IO, -1, path, NULL);
+
+  // String values point into the mapping, which must be kept in
+  // [ctx] whenever a value is applied
+  MicroFlagFile *file = (MicroFlagFile*) malloc(sizeof(MicroFlagFile));
+  if (file == NULL)
+  {
+    munmap(p, size);
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_ALLOC, -1, path, NULL);
+  }
+  MicroFlagError err = micro_flag_cache_apply(set, ctx, key, p, size);
+  if (err != MICRO_FLAG_OK)
+  {
+    free(file);
+    munmap(p, size);
+    ctx->diag.arg = path;
+    return err;
+  }
+
+  file->data   = (char*) p;
+  file->mapped = size;
+  file->dev    = (unsigned long long) st.st_dev;
+  file->ino    = (unsigned long long) st.st_ino;
+  file->open   = false;
+  file->next   = ctx->files;
+  ctx->files   = file;
+  return MICRO_FLAG_OK;
+}
+
+#endif // MICRO_FLAG_POSIX
+
+// Set the boolean short flags named by the bytes in [p, end)
+static void micro_flag_set_cluster(const MicroFlagSet *set,
+                                   MicroFlagContext *ctx,
+                                   const char *p,
+                                   const char *end)
+{
+  for (; p < end; ++p)
+  {
+    const MicroFlag *f = &set->flags[set->short_flags[(unsigned char) *p]];
+    *((bool*) micro_flag_target(f, ctx->base)) = true;
+  }
+}
+
+MicroFlagError micro_flag_feed(const MicroFlagSet *set,
+                               MicroFlagContext *ctx,
+                               char *arg)
+{
+  int index = ++ctx->index;
+  if (ctx->pending != NULL)
+  {
+    const MicroFlag *f = ctx->pending;
+    ctx->pending = NULL;
+    return micro_flag_store(set, ctx, f, index, ctx->pending_arg, arg);
+  }
+
+#ifdef MICRO_FLAG_POSIX
+  if (ctx->response_files && arg[0] == '@' && arg[1] != '\0')
+    return micro_flag_feed_file(set, ctx, arg);
+#endif
+
+  char *value = NULL;
+  int flag;
+  if (micro_flag_is_short(arg) && arg[2] == '\0'
+      && set->short_flags[(unsigned char) arg[1]] != -1)
+  {
+    flag = set->short_flags[(unsigned char) arg[1]];
+  }
+  else if (arg[0] == '-' && arg[1] == '-')
+  {
+    // "--name=value", the name is matched as a view up to the
+    // '=' and the value points into the argument
+    size_t len = strcspn(arg, "=");
+    flag = micro_flag_lookup(set, arg, len);
+    if (arg[len] == '=')
+      value = arg + len + 1;
+  }
+  else
+  {
+    flag = micro_flag_lookup(set, arg, strlen(arg));
+  }
+
+  // POSIX clustering of short flags: "-xvf", "-n42", "-ofile".
+  // Boolean flags run until one takes a value, which is either the
+  // rest of the argument or the next argument. They are only set
+  // once the whole cluster is known, in [cluster, cluster_end)
+  const char *cluster = NULL, *cluster_end = NULL;
+  if (flag == -1 && micro_flag_is_short(arg))
+  {
+    char *p = arg + 1;
+    flag = set->short_flags[(unsigned char) *p];
+    while (flag != -1 && set->flags[flag].type == MICRO_FLAG_BOOL
+           && p[1] != '\0')
+      flag = set->short_flags[(unsigned char) *++p];
+    if (flag != -1)
+    {
+      cluster     = arg + 1;
+      cluster_end = p;
+      if (p[1] != '\0')
+        value = p + 1;
+    }
+  }
+
+  if (flag == -1 && ctx->ignore_unknown)
+    return MICRO_FLAG_OK;
+  if (flag == -1)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_UNKNOWN_FLAG, index, arg, NULL);
+  if (flag == -2)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_AMBIGUOUS_FLAG, index, arg, NULL);
+
+  const MicroFlag *f = &set->flags[flag];
+  if (f->type == MICRO_FLAG_BOOL && value != NULL)
+    return micro_flag_fail(ctx, MICRO_FLAG_ERROR_UNEXPECTED_VALUE, index, arg, f);
+  if (f->type != MICRO_FLAG_BOOL && value == NULL)
+  {
+    ctx->pending       = f;
+    ctx->pending_arg   = arg;
+    ctx->pending_index = index;
+    micro_flag_set_cluster(set, ctx, cluster, cluster_end);
+    return MICRO_FLAG_OK;
+  }
+
+  MicroFlagError err = micro_flag_store(set, ctx, f, index, arg, value);
+  if (err == MICRO_FLAG_OK)
+    micro_flag_set_cluster(set, ctx, cluster, cluster_end);
+  return err;
+}
+
+MicroFlagError micro_flag_finish(const MicroFlagSet *set,
+                                 MicroFlagContext *ctx)
+{
+  (void) set;
+  const MicroFlag *f = ctx->pending;
+  if (f == NULL)
+    return MICRO_FLAG_OK;
+  ctx->pending = NULL;
+  return micro_flag_fail(ctx, micro_flag_missing_error(f->type),
+                         ctx->pending_index, ctx->pending_arg, f);
+}
+
+MicroFlagError micro_flag_parse_r(const MicroFlagSet *set,
+                                  MicroFlagContext *ctx,
+                                  int argc,
+                                  char **argv)
+{
+  micro_flag_context_reset(ctx);
+
+  for (int i = 1; i < argc; ++i)
+  {
+    MicroFlagError err = micro_flag_feed(set, ctx, argv[i]);
+    if (err != MICRO_FLAG_OK)
+      return err;
+  }
+
+  return micro_flag_finish(set, ctx);
+}
+
+MicroFlagError micro_flag_parse_nul(const MicroFlagSet *set,
+                                    MicroFlagContext *ctx,
+                                    char *buf,
+                                    size_t len)
+{
+  micro_flag_context_reset(ctx);
+
+  size_t start = 0;
+  while (start < len)
+  {
+    char *end = (char*) memchr(buf + start, '\0', len - start);
+    if (end == NULL)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_UNTERMINATED,
+                             ctx->index + 1, NULL, NULL);
+    MicroFlagError err = micro_flag_feed(set, ctx, buf + start);
+    if (err != MICRO_FLAG_OK)
+      return err;
+    start = (size_t) (end - buf) + 1;
+  }
+
+  return micro_flag_finish(set, ctx);
+}
+
+#ifdef MICRO_FLAG_POSIX
+
+MicroFlagError micro_flag_parse_stream(const MicroFlagSet *set,
+                                       MicroFlagContext *ctx,
+                                       int fd,
+                                       char *buf,
+                                       size_t cap)
+{
+  micro_flag_context_reset(ctx);
+
+  size_t len = 0;
+  for (;;)
+  {
+    ssize_t r = read(fd, buf + len, cap - len);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_IO, ctx->index + 1, NULL, NULL);
+    len += (size_t) r;
+
+    size_t start = 0;
+    char *end;
+    while ((end = (char*) memchr(buf + start, '\0', len - start)) != NULL)
+    {
+      MicroFlagError err = micro_flag_feed(set, ctx, buf + start);
+      if (err != MICRO_FLAG_OK)
+        return err;
+      start = (size_t) (end - buf) + 1;
+    }
+
+    // Slide the incomplete argument to the start of the window. The
+    // pending argument, if any, was in the part that is reused
+    memmove(buf, buf + start, len - start);
+    len -= start;
+    ctx->pending_arg = NULL;
+
+    if (r == 0)
+    {
+      // The last argument may miss its terminator
+      if (len > 0)
+      {
+        if (len == cap)
+          return micro_flag_fail(ctx, MICRO_FLAG_ERROR_TOO_LONG,
+                                 ctx->index + 1, NULL, NULL);
+        buf[len] = '\0';
+        MicroFlagError err = micro_flag_feed(set, ctx, buf);
+        if (err != MICRO_FLAG_OK)
+          return err;
       }
+      return micro_flag_finish(set, ctx);
+    }
+    if (len == cap)
+      return micro_flag_fail(ctx, MICRO_FLAG_ERROR_TOO_LONG,
+                             ctx->index + 1, NULL, NULL);
+  }
+}
+
+#endif // MICRO_FLAG_POSIX
+
+#ifdef MICRO_FLAG_LINUX
+
+// Read the command line at [path] into [buf] of [cap] bytes with a
+// single read, making sure it ends with a null byte
+static MicroFlagError micro_flag_read_cmdline(const char *path,
+                                              char *buf,
+                                              size_t cap,
+                                              size_t *len)
+{
+  int fd;
+  do
+    fd = open(path, O_RDONLY);
+  while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return MICRO_FLAG_ERROR_IO;
+
+  ssize_t r;
+  do
+    r = read(fd, buf, cap);
+  while (r < 0 && errno == EINTR);
+  close(fd);
+  if (r < 0)
+    return MICRO_FLAG_ERROR_IO;
+
+  // A full buffer may have cut the last argument
+  *len = (size_t) r;
+  if (*len == cap)
+    return MICRO_FLAG_ERROR_TOO_LONG;
+  // Processes can overwrite their arguments and drop the terminator
+  if (*len > 0 && buf[*len - 1] != '\0')
+    buf[(*len)++] = '\0';
+  return MICRO_FLAG_OK;
+}
+
+// Parse the command line of [len] bytes in [buf], skipping argv[0]
+static MicroFlagError micro_flag_parse_cmdline(const MicroFlagSet *set,
+                                               MicroFlagContext *ctx,
+                                               char *buf,
+                                               size_t len)
+{
+  size_t skip = len > 0 ? strlen(buf) + 1 : 0;
+  return micro_flag_parse_nul(set, ctx, buf + skip, len - skip);
+}
+
+MicroFlagError micro_flag_parse_proc(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     int pid,
+                                     char *buf,
+                                     size_t cap)
+{
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+
+  size_t len;
+  MicroFlagError err = micro_flag_read_cmdline(path, buf, cap, &len);
+  if (err != MICRO_FLAG_OK)
+  {
+    micro_flag_context_reset(ctx);
+    return micro_flag_fail(ctx, err, 0, NULL, NULL);
+  }
+  return micro_flag_parse_cmdline(set, ctx, buf, len);
+}
+
+MicroFlagError micro_flag_scan_procs(const MicroFlagSet *set,
+                                     MicroFlagContext *ctx,
+                                     char *buf,
+                                     size_t cap,
+                                     MicroFlagProcFn fn,
+                                     void *data)
+{
+  DIR *dir = opendir("/proc");
+  if (dir == NULL)
+    return MICRO_FLAG_ERROR_IO;
+
+  // "/proc/" + pid + "/cmdline"
+  char path[6 + 256 + 8 + 1];
+  memcpy(path, "/proc/", 6);
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    const char *name = entry->d_name;
+    if (name[0] < '0' || name[0] > '9')
+      continue;
+
+    size_t name_len = strlen(name);
+    memcpy(path + 6, name, name_len);
+    memcpy(path + 6 + name_len, "/cmdline", 9);
+
+    // Processes that exited since readdir, or that cannot be read,
+    // are skipped. So are kernel threads, which have no arguments
+    size_t len;
+    MicroFlagError err = micro_flag_read_cmdline(path, buf, cap, &len);
+    if (err == MICRO_FLAG_ERROR_IO || (err == MICRO_FLAG_OK && len == 0))
+      continue;
+
+    ctx->strings_len = 0;
+    if (err != MICRO_FLAG_OK)
+    {
+      micro_flag_context_reset(ctx);
+      micro_flag_fail(ctx, err, 0, NULL, NULL);
+    }
+    else
+    {
+      micro_flag_parse_cmdline(set, ctx, buf, len);
+    }
+
+    if (fn(atoi(name), ctx, data) != 0)
+      break;
+  }
+
+  closedir(dir);
+  return MICRO_FLAG_OK;
+}
+
+#endif // MICRO_FLAG_LINUX
+
+MicroFlagSink micro_flag_sink_silent(void)
+{
+  MicroFlagSink sink;
+  memset(&sink, 0, sizeof(sink));
+  sink.type = MICRO_FLAG_SINK_SILENT;
+  sink.fd = -1;
+  return sink;
+}
+
+MicroFlagSink micro_flag_sink_file(FILE *file)
+{
+  MicroFlagSink sink = micro_flag_sink_silent();
+  sink.type = MICRO_FLAG_SINK_FILE;
+  sink.file = file;
+  return sink;
+}
+
+MicroFlagSink micro_flag_sink_fd(int fd)
+{
+  MicroFlagSink sink = micro_flag_sink_silent();
+  sink.type = MICRO_FLAG_SINK_FD;
+  sink.fd = fd;
+  return sink;
+}
+
+MicroFlagSink micro_flag_sink_buffer(char *buf, size_t cap)
+{
+  MicroFlagSink sink = micro_flag_sink_silent();
+  sink.type = MICRO_FLAG_SINK_BUFFER;
+  sink.buf = buf;
+  sink.cap = cap;
+  if (cap > 0)
+    buf[0] = '\0';
+  return sink;
+}
+
+void micro_flag_sink_printf(MicroFlagSink *sink, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  switch (sink->type)
+  {
+  case MICRO_FLAG_SINK_FILE:
+    vfprintf(sink->file, fmt, args);
+    break;
+  case MICRO_FLAG_SINK_BUFFER:
+  {
+    if (sink->cap == 0)
+    {
+      sink->truncated = true;
+      break;
+    }
+    size_t avail = sink->cap - sink->len;
+    int n = vsnprintf(sink->buf + sink->len, avail, fmt, args);
+    if (n < 0)
+      break;
+    if ((size_t) n >= avail)
+    {
+      sink->len = sink->cap - 1;
+      sink->truncated = true;
+    }
+    else
+    {
+      sink->len += (size_t) n;
+    }
+    break;
+  }
+  case MICRO_FLAG_SINK_FD:
+  {
+#ifdef MICRO_FLAG_POSIX
+    // Format in one buffer so that the message is a single write
+    char small[256];
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(small, sizeof(small), fmt, copy);
+    va_end(copy);
+    if (n < 0)
+      break;
+    char *msg = small;
+    if ((size_t) n >= sizeof(small))
+    {
+      msg = (char*) malloc((size_t) n + 1);
+      if (msg == NULL)
+        break;
+      vsnprintf(msg, (size_t) n + 1, fmt, args);
+    }
+    for (size_t done = 0; done < (size_t) n;)
+    {
+      ssize_t w = write(sink->fd, msg + done, (size_t) n - done);
+      if (w <= 0)
+        break;
+      done += (size_t) w;
     }
+    if (msg != small)
+      free(msg);
+#endif
+    break;
+  }
+  default:
+    break;
+  }
+  va_end(args);
+}
+
+void micro_flag_write_error(MicroFlagSink *sink,
+                            const MicroFlagDiagnostic *diag)
+{
+  static const char *usage_str[] =
+    { "", "<char>", "<string>", "<integer>", "<double>",
+      "<integer>", "<double>", "<string>" };
+
+  switch (diag->error)
+  {
+  case MICRO_FLAG_OK:
+    break;
+  case MICRO_FLAG_ERROR_UNKNOWN_FLAG:
+    micro_flag_sink_printf(sink, "Error parsing flags: unknown flag \"%s\"\n",
+                           diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_AMBIGUOUS_FLAG:
+    micro_flag_sink_printf(sink, "Error parsing flags: ambiguous flag \"%s\"\n",
+                           diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_UNEXPECTED_VALUE:
+    micro_flag_sink_printf(sink, "Error parsing flags: flag \"%s\" does not take a value\n",
+                           diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_NO_SPACE:
+    if (diag->flag != NULL)
+      micro_flag_sink_printf(sink, "Error parsing flags: no space left for the value of \"%s\"\n",
+                             diag->flag->long_name != NULL
+                             ? diag->flag->long_name : diag->flag->short_name);
+    else
+      micro_flag_sink_printf(sink, "Error parsing flags: no space left to split \"%s\"\n",
+                             diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_TOO_LONG:
+    micro_flag_sink_printf(sink, "Error parsing flags: argument %d is too long\n",
+                           diag->index);
+    break;
+  case MICRO_FLAG_ERROR_UNTERMINATED:
+    micro_flag_sink_printf(sink, "Error parsing flags: argument %d is not terminated\n",
+                           diag->index);
+    break;
+  case MICRO_FLAG_ERROR_IO:
+    if (diag->arg != NULL)
+      micro_flag_sink_printf(sink, "Error parsing flags: could not read \"%s\"\n",
+                             diag->arg);
+    else
+      micro_flag_sink_printf(sink, "Error parsing flags: could not read argument %d\n",
+                             diag->index);
+    break;
+  case MICRO_FLAG_ERROR_INCLUDE_CYCLE:
+    micro_flag_sink_printf(sink, "Error parsing flags: \"%s\" includes itself\n",
+                           diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_SYNTAX:
+    micro_flag_sink_printf(sink, "Error parsing flags: expected \"key = value\" at line %d, found \"%s\"\n",
+                           diag->index, diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_BAD_CACHE:
+    micro_flag_sink_printf(sink, "Error parsing flags: \"%s\" is not a valid cache\n",
+                           diag->arg != NULL ? diag->arg : "");
+    break;
+  case MICRO_FLAG_ERROR_NO_BASE:
+    micro_flag_sink_printf(sink, "Error parsing flags: parallel parses need an offset table and a base\n");
+    break;
+  case MICRO_FLAG_ERROR_STALE_CACHE:
+    micro_flag_sink_printf(sink, "Error parsing flags: the cache \"%s\" is out of date\n",
+                           diag->arg != NULL ? diag->arg : "");
+    break;
+  case MICRO_FLAG_ERROR_NOT_ATOMIC:
+    micro_flag_sink_printf(sink, "Error parsing flags: flag \"%s\" cannot be changed at runtime\n",
+                           diag->arg);
+    break;
+  case MICRO_FLAG_ERROR_NOT_A_BOOL:
+    micro_flag_sink_printf(sink, "Error parsing flags: the value of \"%s\" is not a boolean\n",
+                           diag->arg);
+    break;
+  default:
+    if (diag->flag && diag->flag->type > MICRO_FLAG_BOOL
+        && diag->flag->type < _MICRO_FLAG_MAX)
+      micro_flag_sink_printf(sink, "Usage: %s%s%s %s\n",
+                             diag->flag->short_name != NULL
+                             ? diag->flag->short_name : "",
+                             diag->flag->short_name != NULL
+                             && diag->flag->long_name != NULL ? "," : "",
+                             diag->flag->long_name != NULL
+                             ? diag->flag->long_name : "",
+                             usage_str[diag->flag->type]);
+    break;
+  }
+}
+
+MicroFlagError micro_flag_parse_set(const MicroFlagSet *set,
+                                    int argc,
+                                    char **argv)
+{
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+  MicroFlagError err = micro_flag_parse_r(set, &ctx, argc, argv);
+  MicroFlagSink sink = micro_flag_sink_file(stderr);
+  micro_flag_write_error(&sink, &ctx.diag);
+  return err;
+}
+
+MicroFlagError micro_flag_parse_batch(const MicroFlagSet *set,
+                                      char ***argvs,
+                                      const int *argcs,
+                                      size_t n,
+                                      void *base,
+                                      size_t stride,
+                                      MicroFlagDiagnostic *results)
+{
+  // Items ahead of the current one whose argv array, and then
+  // whose arguments, are fetched into the cache
+  const size_t array_distance = 8, args_distance = 4;
+  MicroFlagError first_error = MICRO_FLAG_OK;
+  MicroFlagContext ctx;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (i + array_distance < n)
+      MICRO_FLAG_PREFETCH(argvs[i + array_distance]);
+    if (i + args_distance < n)
+      for (int a = 1; a < argcs[i + args_distance] && a <= 4; ++a)
+        MICRO_FLAG_PREFETCH(argvs[i + args_distance][a]);
+
+    micro_flag_context_init(&ctx, base ? (char*) base + i * stride : NULL);
+    MicroFlagError err = micro_flag_parse_r(set, &ctx, argcs[i], argvs[i]);
+    results[i] = ctx.diag;
+    if (err != MICRO_FLAG_OK && first_error == MICRO_FLAG_OK)
+      first_error = err;
+  }
+
+  return first_error;
+}
+
+#ifdef MICRO_FLAG_THREADS
+
+// Chunks of items [top, bottom) of a worker. The owner takes them
+// from the bottom, thieves from the top
+typedef struct {
+  pthread_mutex_t lock;
+  size_t top;
+  size_t bottom;
+} MicroFlagDeque;
+
+// A batch parsed by the workers of a pool
+typedef struct {
+  const MicroFlagSet *set;
+  char ***argvs;
+  const int *argcs;
+  size_t n;
+  void *base;
+  size_t stride;
+  MicroFlagDiagnostic *results;
+  size_t chunk_size;
+} MicroFlagBatch;
+
+struct MicroFlagWorker {
+  MicroFlagPool *pool;
+  unsigned int id;
+  pthread_t thread;
+  MicroFlagDeque deque;
+  // Smallest index of a failed item of the current batch, or n
+  size_t first_error;
+};
+
+// Take a chunk from [deque], from the bottom if [owner]
+static bool micro_flag_deque_take(MicroFlagDeque *deque, bool owner, size_t *chunk)
+{
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->top < deque->bottom)
+  {
+    *chunk = owner ? --deque->bottom : deque->top++;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// Parse the chunks of [batch] that [worker] can take
+static void micro_flag_worker_batch(struct MicroFlagWorker *worker,
+                                    const MicroFlagBatch *batch)
+{
+  MicroFlagPool *pool = worker->pool;
+  size_t chunk;
+
+  for (;;)
+  {
+    bool found = micro_flag_deque_take(&worker->deque, true, &chunk);
+    for (unsigned int v = 1; !found && v < pool->num_workers; ++v)
+      found = micro_flag_deque_take(&pool->workers[(worker->id + v) % pool->num_workers].deque,
+                                    false, &chunk);
+    // Nothing is ever pushed, so empty deques stay empty
     if (!found)
+      break;
+
+    size_t first = chunk * batch->chunk_size;
+    size_t count = batch->n - first < batch->chunk_size
+      ? batch->n - first : batch->chunk_size;
+    if (micro_flag_parse_batch(batch->set, batch->argvs + first, batch->argcs + first,
+                               count, (char*) batch->base + first * batch->stride,
+                               batch->stride, batch->results + first)
+        != MICRO_FLAG_OK)
     {
-      printf("Error parsing flags: unknown flag \"%s\"\n", argv[i]);
-      return MICRO_FLAG_ERROR_UNKNOWN_FLAG;
+      size_t i = first;
+      while (batch->results[i].error == MICRO_FLAG_OK)
+        i++;
+      if (i < worker->first_error)
+        worker->first_error = i;
     }
   }
-  
+}
+
+static void *micro_flag_worker_run(void *arg)
+{
+  struct MicroFlagWorker *worker = (struct MicroFlagWorker*) arg;
+  MicroFlagPool *pool = worker->pool;
+  unsigned long long seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;)
+  {
+    while (!pool->stop && pool->generation == seen)
+      pthread_cond_wait(&pool->start, &pool->lock);
+    if (pool->stop)
+      break;
+    seen = pool->generation;
+    const MicroFlagBatch *batch = (const MicroFlagBatch*) pool->batch;
+    pthread_mutex_unlock(&pool->lock);
+
+    micro_flag_worker_batch(worker, batch);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->running == 0)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+MicroFlagError micro_flag_pool_init(MicroFlagPool *pool,
+                                    unsigned int num_threads)
+{
+  if (num_threads == 0)
+    num_threads = 1;
+  pool->workers = (struct MicroFlagWorker*) malloc(num_threads * sizeof(struct MicroFlagWorker));
+  if (pool->workers == NULL)
+    return MICRO_FLAG_ERROR_ALLOC;
+  pool->batch      = NULL;
+  pool->generation = 0;
+  pool->running    = 0;
+  pool->stop       = false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  // The calling thread is worker 0. Workers are numbered in the
+  // order they started, so a failed start leaves no hole
+  pool->workers[0].pool = pool;
+  pool->workers[0].id   = 0;
+  pthread_mutex_init(&pool->workers[0].deque.lock, NULL);
+  pool->num_workers = 1;
+  for (unsigned int w = 1; w < num_threads; ++w)
+  {
+    struct MicroFlagWorker *worker = &pool->workers[pool->num_workers];
+    worker->pool = pool;
+    worker->id   = pool->num_workers;
+    pthread_mutex_init(&worker->deque.lock, NULL);
+    if (pthread_create(&worker->thread, NULL, micro_flag_worker_run, worker) != 0)
+    {
+      pthread_mutex_destroy(&worker->deque.lock);
+      continue;
+    }
+    pool->num_workers++;
+  }
   return MICRO_FLAG_OK;
 }
 
-MicroFlagError micro_flag_print_help(const char* prog_name,
-                                     const char* description,
-                                     MicroFlag *flags,
-                                     unsigned int num_flags)
+void micro_flag_pool_free(MicroFlagPool *pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for (unsigned int w = 0; w < pool->num_workers; ++w)
+  {
+    if (w > 0)
+      pthread_join(pool->workers[w].thread, NULL);
+    pthread_mutex_destroy(&pool->workers[w].deque.lock);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  pool->workers = NULL;
+  pool->num_workers = 0;
+}
+
+MicroFlagError micro_flag_parse_batch_pool(MicroFlagPool *pool,
+                                           const MicroFlagSet *set,
+                                           char ***argvs,
+                                           const int *argcs,
+                                           size_t n,
+                                           void *base,
+                                           size_t stride,
+                                           MicroFlagDiagnostic *results)
+{
+  if (base == NULL)
+    return MICRO_FLAG_ERROR_NO_BASE;
+
+  MicroFlagBatch batch;
+  batch.set        = set;
+  batch.argvs      = argvs;
+  batch.argcs      = argcs;
+  batch.n          = n;
+  batch.base       = base;
+  batch.stride     = stride;
+  batch.results    = results;
+  batch.chunk_size = 1024;
+
+  // Each worker starts with a contiguous share of the chunks
+  size_t num_chunks = (n + batch.chunk_size - 1) / batch.chunk_size;
+  unsigned int num_workers = pool->num_workers;
+  for (unsigned int w = 0; w < num_workers; ++w)
+  {
+    struct MicroFlagWorker *worker = &pool->workers[w];
+    worker->deque.top    = num_chunks * w / num_workers;
+    worker->deque.bottom = num_chunks * (w + 1) / num_workers;
+    worker->first_error  = n;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->batch   = &batch;
+  pool->running = num_workers - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  micro_flag_worker_batch(&pool->workers[0], &batch);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->running > 0)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pool->batch = NULL;
+  pthread_mutex_unlock(&pool->lock);
+
+  size_t first_error = n;
+  for (unsigned int w = 0; w < num_workers; ++w)
+    if (pool->workers[w].first_error < first_error)
+      first_error = pool->workers[w].first_error;
+  return (first_error < n) ? results[first_error].error : MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_parse_batch_parallel(const MicroFlagSet *set,
+                                               char ***argvs,
+                                               const int *argcs,
+                                               size_t n,
+                                               void *base,
+                                               size_t stride,
+                                               MicroFlagDiagnostic *results,
+                                               unsigned int num_threads)
+{
+  if (base == NULL)
+    return MICRO_FLAG_ERROR_NO_BASE;
+
+  // No more threads than chunks
+  size_t num_chunks = (n + 1023) / 1024;
+  if (num_threads > num_chunks)
+    num_threads = (unsigned int) num_chunks;
+  MicroFlagPool pool;
+  if (num_threads <= 1 || micro_flag_pool_init(&pool, num_threads) != MICRO_FLAG_OK)
+    return micro_flag_parse_batch(set, argvs, argcs, n, base, stride, results);
+
+  MicroFlagError err = micro_flag_parse_batch_pool(&pool, set, argvs, argcs,
+                                                   n, base, stride, results);
+  micro_flag_pool_free(&pool);
+  return err;
+}
+
+#endif // MICRO_FLAG_THREADS
+
+#ifdef MICRO_FLAG_RELOAD
+
+static void micro_flag_snapshot_free(MicroFlagSnapshot *snap)
+{
+  micro_flag_context_release(&snap->ctx);
+  free(snap);
+}
+
+// Create a snapshot filled by the load function of [reload]
+static MicroFlagError micro_flag_snapshot_load(MicroFlagReload *reload,
+                                               MicroFlagSink *errors,
+                                               MicroFlagSnapshot **out)
+{
+  // The result struct follows the header, aligned for any member
+  size_t header = (sizeof(MicroFlagSnapshot) + 15) & ~(size_t) 15;
+  MicroFlagSnapshot *snap = (MicroFlagSnapshot*) malloc(header + reload->size);
+  if (snap == NULL)
+    return MICRO_FLAG_ERROR_ALLOC;
+  snap->next    = NULL;
+  snap->retired = 0;
+  snap->values  = (char*) snap + header;
+  if (reload->defaults != NULL)
+    memcpy(snap->values, reload->defaults, reload->size);
+  else
+    memset(snap->values, 0, reload->size);
+
+  // Snapshots outlive changes to the files they were loaded from
+  micro_flag_context_init(&snap->ctx, snap->values);
+  snap->ctx.copy_files = true;
+  MicroFlagError err = reload->load(reload->set, &snap->ctx, reload->data);
+  if (err != MICRO_FLAG_OK)
+  {
+    if (errors != NULL)
+      micro_flag_write_error(errors, &snap->ctx.diag);
+    micro_flag_snapshot_free(snap);
+    return err;
+  }
+
+  *out = snap;
+  return MICRO_FLAG_OK;
+}
+
+// Free the retired snapshots that no reader can hold: those retired
+// in an epoch not later than the one of the oldest running read.
+// Called with the lock held
+static void micro_flag_reload_reclaim(MicroFlagReload *reload)
+{
+  unsigned long long oldest = ULLONG_MAX;
+  for (MicroFlagReader *r = reload->readers; r != NULL; r = r->next)
+  {
+    unsigned long long epoch = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+    if (epoch != 0 && epoch < oldest)
+      oldest = epoch;
+  }
+
+  MicroFlagSnapshot **p = &reload->retired;
+  while (*p != NULL)
+  {
+    MicroFlagSnapshot *snap = *p;
+    if (snap->retired <= oldest)
+    {
+      *p = snap->next;
+      micro_flag_snapshot_free(snap);
+    }
+    else
+    {
+      p = &snap->next;
+    }
+  }
+}
+
+MicroFlagError micro_flag_reload_init(MicroFlagReload *reload,
+                                      const MicroFlagSet *set,
+                                      const void *defaults,
+                                      size_t size,
+                                      MicroFlagLoadFn load,
+                                      void *data,
+                                      MicroFlagSink *errors)
+{
+  reload->set        = set;
+  reload->defaults   = defaults;
+  reload->size       = size;
+  reload->load       = load;
+  reload->data       = data;
+  reload->current    = NULL;
+  reload->epoch      = 1;
+  reload->readers    = NULL;
+  reload->retired    = NULL;
+  reload->watch_fd   = -1;
+  reload->watch_name = NULL;
+
+  // The lock comes first, so that micro_flag_reload_free can always
+  // destroy it
+  if (pthread_mutex_init(&reload->lock, NULL) != 0)
+    return MICRO_FLAG_ERROR_ALLOC;
+  return micro_flag_snapshot_load(reload, errors, &reload->current);
+}
+
+MicroFlagError micro_flag_reload(MicroFlagReload *reload,
+                                 MicroFlagSink *errors)
+{
+  MicroFlagSnapshot *snap;
+  MicroFlagError err = micro_flag_snapshot_load(reload, errors, &snap);
+  if (err != MICRO_FLAG_OK)
+    return err;
+
+  // Reads that start in the new epoch load the new snapshot, as the
+  // swap comes before the epoch moves
+  pthread_mutex_lock(&reload->lock);
+  MicroFlagSnapshot *old =
+    __atomic_exchange_n(&reload->current, snap, __ATOMIC_SEQ_CST);
+  // There is none to retire if micro_flag_reload_init failed to load
+  if (old != NULL)
+  {
+    old->retired = __atomic_add_fetch(&reload->epoch, 1, __ATOMIC_SEQ_CST);
+    old->next = reload->retired;
+    reload->retired = old;
+  }
+  micro_flag_reload_reclaim(reload);
+  pthread_mutex_unlock(&reload->lock);
+  return MICRO_FLAG_OK;
+}
+
+void micro_flag_reload_free(MicroFlagReload *reload)
+{
+  while (reload->retired != NULL)
+  {
+    MicroFlagSnapshot *snap = reload->retired;
+    reload->retired = snap->next;
+    micro_flag_snapshot_free(snap);
+  }
+  if (reload->current != NULL)
+    micro_flag_snapshot_free(reload->current);
+  reload->current = NULL;
+#ifdef MICRO_FLAG_LINUX
+  if (reload->watch_fd >= 0)
+    close(reload->watch_fd);
+  reload->watch_fd = -1;
+#endif
+  pthread_mutex_destroy(&reload->lock);
+}
+
+void micro_flag_reader_register(MicroFlagReload *reload,
+                                MicroFlagReader *reader)
+{
+  reader->epoch = 0;
+  pthread_mutex_lock(&reload->lock);
+  reader->next = reload->readers;
+  reload->readers = reader;
+  pthread_mutex_unlock(&reload->lock);
+}
+
+void micro_flag_reader_unregister(MicroFlagReload *reload,
+                                  MicroFlagReader *reader)
+{
+  pthread_mutex_lock(&reload->lock);
+  MicroFlagReader **p = &reload->readers;
+  while (*p != NULL && *p != reader)
+    p = &(*p)->next;
+  if (*p != NULL)
+    *p = reader->next;
+  pthread_mutex_unlock(&reload->lock);
+}
+
+const void *micro_flag_read_begin(MicroFlagReload *reload,
+                                  MicroFlagReader *reader)
+{
+  // Announce the epoch before loading the snapshot, so that a reload
+  // that does not see the announcement has already swapped it
+  __atomic_store_n(&reader->epoch,
+                   __atomic_load_n(&reload->epoch, __ATOMIC_SEQ_CST),
+                   __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&reload->current, __ATOMIC_SEQ_CST)->values;
+}
+
+void micro_flag_read_end(MicroFlagReader *reader)
+{
+  __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+#ifdef MICRO_FLAG_LINUX
+
+MicroFlagError micro_flag_reload_watch(MicroFlagReload *reload,
+                                       const char *path)
+{
+  char dir[4096] = ".";
+  const char *slash = strrchr(path, '/');
+  if (slash != NULL)
+  {
+    size_t len = slash == path ? 1 : (size_t) (slash - path);
+    if (len >= sizeof(dir))
+      return MICRO_FLAG_ERROR_IO;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+  }
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return MICRO_FLAG_ERROR_IO;
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    close(fd);
+    return MICRO_FLAG_ERROR_IO;
+  }
+
+  if (reload->watch_fd >= 0)
+    close(reload->watch_fd);
+  reload->watch_fd   = fd;
+  reload->watch_name = slash != NULL ? slash + 1 : path;
+  return MICRO_FLAG_OK;
+}
+
+MicroFlagError micro_flag_reload_poll(MicroFlagReload *reload,
+                                      MicroFlagSink *errors)
+{
+  if (reload->watch_fd < 0)
+    return MICRO_FLAG_OK;
+
+  // Aligned for struct inotify_event
+  unsigned long long events[512];
+  bool changed = false;
+  for (;;)
+  {
+    ssize_t r = read(reload->watch_fd, events, sizeof(events));
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    for (char *p = (char*) events; p < (char*) events + r;)
+    {
+      struct inotify_event *event = (struct inotify_event*) p;
+      if (event->len > 0 && strcmp(event->name, reload->watch_name) == 0)
+        changed = true;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return changed ? micro_flag_reload(reload, errors) : MICRO_FLAG_OK;
+}
+
+#endif // MICRO_FLAG_LINUX
+
+#endif // MICRO_FLAG_RELOAD
+
+MicroFlagError micro_flag_set(const MicroFlagSet *set,
+                              void *base,
+                              const char *name,
+                              const char *value)
+{
+  int flag = micro_flag_lookup(set, name, strlen(name));
+  if (flag == -1)
+    return MICRO_FLAG_ERROR_UNKNOWN_FLAG;
+  if (flag == -2)
+    return MICRO_FLAG_ERROR_AMBIGUOUS_FLAG;
+
+  const MicroFlag *f = &set->flags[flag];
+  if (f->type != MICRO_FLAG_ATOMIC_INT && f->type != MICRO_FLAG_ATOMIC_DOUBLE
+      && f->type != MICRO_FLAG_ATOMIC_STR)
+    return MICRO_FLAG_ERROR_NOT_ATOMIC;
+  return micro_flag_set_value(f, micro_flag_target(f, base), (char*) value);
+}
+
+MicroFlagError micro_flag_parse(MicroFlag *flags,
+                                unsigned int num_flags,
+                                int argc,
+                                char **argv)
+{
+  MicroFlagSet set;
+  MicroFlagError err = micro_flag_compile(&set, flags, num_flags);
+  if (err != MICRO_FLAG_OK)
+    return err;
+
+  err = micro_flag_parse_set(&set, argc, argv);
+  micro_flag_free(&set);
+  return err;
+}
+
+// Write the [n] parts of [len] bytes at [parts] to [sink], with a
+// single writev for file descriptors
+static void micro_flag_sink_write_parts(MicroFlagSink *sink,
+                                        const char **parts,
+                                        const size_t *lens,
+                                        size_t n)
+{
+  switch (sink->type)
+  {
+  case MICRO_FLAG_SINK_FILE:
+    for (size_t i = 0; i < n; ++i)
+      fwrite(parts[i], 1, lens[i], sink->file);
+    break;
+  case MICRO_FLAG_SINK_BUFFER:
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (sink->cap == 0 || sink->cap - 1 - sink->len < lens[i])
+      {
+        size_t avail = sink->cap == 0 ? 0 : sink->cap - 1 - sink->len;
+        memcpy(sink->buf + sink->len, parts[i], avail);
+        sink->len += avail;
+        sink->truncated = true;
+        break;
+      }
+      memcpy(sink->buf + sink->len, parts[i], lens[i]);
+      sink->len += lens[i];
+    }
+    if (sink->cap > 0)
+      sink->buf[sink->len] = '\0';
+    break;
+  case MICRO_FLAG_SINK_FD:
+  {
+#ifdef MICRO_FLAG_POSIX
+    struct iovec iov[64];
+    size_t i = 0, skip = 0;
+    while (i < n)
+    {
+      // Batch the parts left, the first one may be partly written
+      int count = 0;
+      for (size_t j = i; j < n && count < 64; ++j, ++count)
+      {
+        iov[count].iov_base = (void*) (parts[j] + (j == i ? skip : 0));
+        iov[count].iov_len  = lens[j] - (j == i ? skip : 0);
+      }
+      ssize_t w = writev(sink->fd, iov, count);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+        break;
+      size_t done = (size_t) w;
+      while (i < n && done >= lens[i] - skip)
+      {
+        done -= lens[i] - skip;
+        skip = 0;
+        ++i;
+      }
+      skip += done;
+    }
+#endif
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void micro_flag_sink_write(MicroFlagSink *sink, const char *data, size_t len)
+{
+  micro_flag_sink_write_parts(sink, &data, &len, 1);
+}
+
+// Width of the names column of [flag]: "-o, --output <str>", with the
+// short name as long as it is, or four blanks in its place
+static size_t micro_flag_help_names_len(const MicroFlag *flag)
+{
+  size_t len = 0;
+  if (flag->short_name != NULL)
+    len += strlen(flag->short_name);
+  if (flag->short_name != NULL && flag->long_name != NULL)
+    len += 2;
+  else if (flag->long_name != NULL)
+    len += 4;
+  if (flag->long_name != NULL)
+    len += strlen(flag->long_name);
+  if (flag->type > MICRO_FLAG_BOOL && flag->type < _MICRO_FLAG_MAX)
+    len += 1 + strlen(micro_flag_type_str[flag->type]);
+  return len;
+}
+
+// Render the help of [flags] into [out] if not NULL, and the start of
+// the line of each flag into [lines]
+//
+// Returns: the length of the help
+static size_t micro_flag_help_render_to(char *out,
+                                        size_t *lines,
+                                        const char *prog_name,
+                                        const char *description,
+                                        const MicroFlag *flags,
+                                        unsigned int num_flags)
 {
-  printf("%s\n", prog_name);
-  printf("%s\n", description);
-  printf("\n");
-  printf("Options:\n");
+  // Longer names push their description to the next line
+  const size_t max_names = 32;
+  size_t names = 0;
+  for (unsigned int i = 0; i < num_flags; ++i)
+  {
+    size_t len = micro_flag_help_names_len(&flags[i]);
+    if (len <= max_names && len > names)
+      names = len;
+  }
+
+  size_t len = 0;
+#define MICRO_FLAG_EMIT(str, n)                        \
+  do {                                                 \
+    if (out != NULL)                                   \
+      memcpy(out + len, (str), (n));                   \
+    len += (n);                                        \
+  } while (0)
+#define MICRO_FLAG_EMIT_STR(str) MICRO_FLAG_EMIT((str), strlen(str))
+#define MICRO_FLAG_EMIT_PAD(n)                         \
+  do {                                                 \
+    if (out != NULL)                                   \
+      memset(out + len, ' ', (n));                     \
+    len += (n);                                        \
+  } while (0)
+
+  MICRO_FLAG_EMIT_STR(prog_name);
+  MICRO_FLAG_EMIT("\n", 1);
+  MICRO_FLAG_EMIT_STR(description);
+  MICRO_FLAG_EMIT("\n\nOptions:\n", 11);
 
   for (unsigned int i = 0; i < num_flags; ++i)
   {
-    bool has_short = (flags[i].short_name != NULL);
-    bool has_long = (flags[i].long_name != NULL);
-    printf("    %s%s%s %s\n        %s\n",
-           (has_short ? flags[i].short_name : ""),
-           (has_long && has_short) ? "," : "",
-           (has_long ? flags[i].long_name : ""),
-           micro_flag_type_str[flags[i].type],
-           flags[i].description);
+    const MicroFlag *f = &flags[i];
+    if (lines != NULL)
+      lines[i] = len;
+    MICRO_FLAG_EMIT_PAD(2);
+    if (f->short_name != NULL)
+      MICRO_FLAG_EMIT_STR(f->short_name);
+    if (f->short_name != NULL && f->long_name != NULL)
+      MICRO_FLAG_EMIT(", ", 2);
+    else if (f->long_name != NULL)
+      MICRO_FLAG_EMIT_PAD(4);
+    if (f->long_name != NULL)
+      MICRO_FLAG_EMIT_STR(f->long_name);
+    if (f->type > MICRO_FLAG_BOOL && f->type < _MICRO_FLAG_MAX)
+    {
+      MICRO_FLAG_EMIT(" ", 1);
+      MICRO_FLAG_EMIT_STR(micro_flag_type_str[f->type]);
+    }
+
+    size_t used = micro_flag_help_names_len(f);
+    if (used > names)
+    {
+      MICRO_FLAG_EMIT("\n", 1);
+      MICRO_FLAG_EMIT_PAD(2 + names + 2);
+    }
+    else
+    {
+      MICRO_FLAG_EMIT_PAD(names - used + 2);
+    }
+    if (f->description != NULL)
+      MICRO_FLAG_EMIT_STR(f->description);
+    MICRO_FLAG_EMIT("\n", 1);
   }
-  
+  if (lines != NULL)
+    lines[num_flags] = len;
+
+#undef MICRO_FLAG_EMIT_PAD
+#undef MICRO_FLAG_EMIT_STR
+#undef MICRO_FLAG_EMIT
+  return len;
+}
+
+MicroFlagError micro_flag_help_render(MicroFlagHelp *help,
+                                      const MicroFlagSet *set,
+                                      const char *prog_name,
+                                      const char *description)
+{
+  size_t len = micro_flag_help_render_to(NULL, NULL, prog_name, description,
+                                         set->flags, set->num_flags);
+  help->set   = set;
+  help->len   = len;
+  help->text  = (char*) malloc(len + 1);
+  help->lines = (size_t*) malloc((set->num_flags + 1) * sizeof(size_t));
+  if (help->text == NULL || help->lines == NULL)
+  {
+    micro_flag_help_free(help);
+    return MICRO_FLAG_ERROR_ALLOC;
+  }
+  micro_flag_help_render_to(help->text, help->lines, prog_name, description,
+                            set->flags, set->num_flags);
+  help->text[len] = '\0';
+  return MICRO_FLAG_OK;
+}
+
+void micro_flag_help_free(MicroFlagHelp *help)
+{
+  free(help->text);
+  free(help->lines);
+  help->text  = NULL;
+  help->lines = NULL;
+}
+
+// Search [needle] in the [len] bytes of [text]
+static bool micro_flag_contains(const char *text, size_t len, const char *needle)
+{
+  size_t n = strlen(needle);
+  if (n == 0)
+    return true;
+  for (const char *p = text; n <= len - (size_t) (p - text);)
+  {
+    p = (const char*) memchr(p, needle[0], len - (size_t) (p - text) - n + 1);
+    if (p == NULL)
+      return false;
+    if (memcmp(p, needle, n) == 0)
+      return true;
+    ++p;
+  }
+  return false;
+}
+
+unsigned int micro_flag_help_write(const MicroFlagHelp *help,
+                                   MicroFlagSink *sink,
+                                   const char *filter)
+{
+  const MicroFlagSet *set = help->set;
+  if (filter == NULL)
+  {
+    micro_flag_sink_write(sink, help->text, help->len);
+    return set->num_flags;
+  }
+
+  // The header, then the line of the flag named by [filter] or the
+  // lines that contain it. Adjacent lines are merged in one part
+  const char *parts[64 + 1];
+  size_t lens[64 + 1];
+  size_t n = 0;
+  unsigned int matches = 0;
+  parts[n] = help->text;
+  lens[n++] = help->lines[0];
+
+  int named = filter[0] == '-' ? micro_flag_lookup(set, filter, strlen(filter)) : -1;
+  for (unsigned int i = 0; i < set->num_flags; ++i)
+  {
+    const char *line = help->text + help->lines[i];
+    size_t line_len = help->lines[i + 1] - help->lines[i];
+    if (named >= 0 ? (int) i != named : !micro_flag_contains(line, line_len, filter))
+      continue;
+    matches++;
+    if (parts[n - 1] + lens[n - 1] == line)
+    {
+      lens[n - 1] += line_len;
+      continue;
+    }
+    if (n == 64 + 1)
+    {
+      micro_flag_sink_write_parts(sink, parts, lens, n);
+      n = 0;
+    }
+    parts[n] = line;
+    lens[n++] = line_len;
+  }
+  micro_flag_sink_write_parts(sink, parts, lens, n);
+  return matches;
+}
+
+bool micro_flag_help_requested(int argc,
+                               char **argv,
+                               const char *name,
+                               const char **filter)
+{
+  size_t len = strlen(name);
+  *filter = NULL;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strncmp(argv[i], name, len) != 0)
+      continue;
+    if (argv[i][len] == '\0')
+      return true;
+    if (argv[i][len] == '=')
+    {
+      *filter = argv[i] + len + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+MicroFlagError micro_flag_write_help(MicroFlagSink *sink,
+                                     const char* prog_name,
+                                     const char* description,
+                                     const MicroFlag *flags,
+                                     unsigned int num_flags)
+{
+  size_t len = micro_flag_help_render_to(NULL, NULL, prog_name, description,
+                                         flags, num_flags);
+  char *text = (char*) malloc(len);
+  if (text == NULL)
+    return MICRO_FLAG_ERROR_ALLOC;
+  micro_flag_help_render_to(text, NULL, prog_name, description,
+                            flags, num_flags);
+  micro_flag_sink_write(sink, text, len);
+  free(text);
   return MICRO_FLAG_OK;
 }
 
+MicroFlagError micro_flag_print_help(const char* prog_name,
+                                     const char* description,
+                                     MicroFlag *flags,
+                                     unsigned int num_flags)
+{
+  MicroFlagSink sink = micro_flag_sink_file(stdout);
+  return micro_flag_write_help(&sink, prog_name, description,
+                               flags, num_flags);
+}
+
 #endif // MICRO_FLAG_IMPLEMENTATION
 
 //
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: MIT
+//
+// micro-flag.hpp
+// --------------
+//
+// C++17 companion of micro-flag.h to build the name index of a flag
+// table at compile time.
+//
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// License: MIT
+//
+//
+// Usage
+// -----
+//
+// This header only needs micro-flag.h, the implementation of the
+// library must still be created in one C or C++ file with
+// MICRO_FLAG_IMPLEMENTATION.
+//
+// Describe the flags in a constexpr table and build a micro_flag::index
+// from it. The index is a minimal perfect hash on the short and long
+// names of the flags, computed entirely by the compiler: a duplicate
+// name is a compile error and there is nothing to build at startup.
+//
+// ```
+// static constexpr micro_flag::spec specs[] =
+//   {
+//     { MICRO_FLAG_BOOL, "-h", "--help",   "show help message" },
+//     { MICRO_FLAG_STR,  "-o", "--output", "set output file"   },
+//     { MICRO_FLAG_INT,  "-n", "--number", "print this number" },
+//   };
+// static constexpr auto index = micro_flag::make_index(specs);
+// ```
+//
+// At runtime, bind the variables to set to the flags, in the same
+// order as the table, and parse through the index:
+//
+// ```
+// auto flags = index.bind({ &args.show_help, &args.out_name,
+//                           &args.a_number });
+// MicroFlagSet set = index.set(flags.data());
+// if (micro_flag_parse_set(&set, argc, argv) != MICRO_FLAG_OK)
+//   return 1;
+// ```
+//
+// Looking up an argument is one hash of its bytes, one load from the
+// displacement table and one compare.
+//
+
+#ifndef _MICRO_FLAG_HPP_
+#define _MICRO_FLAG_HPP_
+
+#include "micro-flag.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace micro_flag
+{
+
+// A flag without the pointer to its value, so that it can be constexpr
+struct spec {
+  MicroFlagType type;
+  const char *short_name;
+  const char *long_name;
+  const char *description;
+};
+
+namespace detail
+{
+
+constexpr std::size_t length(const char *s)
+{
+  std::size_t len = 0;
+  while (s[len] != '\0')
+    ++len;
+  return len;
+}
+
+constexpr bool equal(const char *a, std::size_t a_len,
+                     const char *b, std::size_t b_len)
+{
+  if (a_len != b_len)
+    return false;
+  for (std::size_t i = 0; i < a_len; ++i)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+
+// FNV-1a, computed once per lookup
+constexpr std::uint64_t hash(const char *s, std::size_t len)
+{
+  std::uint64_t h = 14695981039346656037ull;
+  for (std::size_t i = 0; i < len; ++i)
+  {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Derive a new hash from [h] and [seed] without reading the name again
+constexpr std::uint32_t mix(std::uint64_t h, std::uint32_t seed)
+{
+  h ^= seed * 0x9e3779b97f4a7c15ull;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return static_cast<std::uint32_t>(h);
+}
+
+} // namespace detail
+
+// Minimal perfect hash on the names of [N] flags
+template <std::size_t N>
+class index {
+public:
+  constexpr explicit index(const spec (&specs)[N])
+  {
+    for (std::size_t flag = 0; flag < N; ++flag)
+    {
+      specs_[flag] = specs[flag];
+      if (specs[flag].short_name)
+        add_key(specs[flag].short_name, static_cast<int>(flag));
+      if (specs[flag].long_name)
+        add_key(specs[flag].long_name, static_cast<int>(flag));
+    }
+
+    build();
+  }
+
+  // Find the flag named [name] of [len] bytes
+  //
+  // Returns: the index of the flag in the table, or -1 if not found
+  constexpr int lookup(const char *name, std::size_t len) const noexcept
+  {
+    if (num_keys_ == 0)
+      return -1;
+    std::uint64_t h = detail::hash(name, len);
+    std::uint32_t seed = seeds_[detail::mix(h, 0) % num_buckets];
+    const key &k = slots_[detail::mix(h, seed) % num_keys_];
+    if (!detail::equal(k.name, k.len, name, len))
+      return -1;
+    return k.flag;
+  }
+
+  // Create the runtime flag table, setting the value of each flag
+  // to the pointer at the same position in [values]
+  std::array<MicroFlag, N> bind(void *const (&values)[N]) const noexcept
+  {
+    std::array<MicroFlag, N> flags{};
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      flags[i].type        = specs_[i].type;
+      flags[i].value       = values[i];
+      flags[i].short_name  = const_cast<char*>(specs_[i].short_name);
+      flags[i].long_name   = const_cast<char*>(specs_[i].long_name);
+      flags[i].description = const_cast<char*>(specs_[i].description);
+    }
+    return flags;
+  }
+
+  // Create an offset table, setting the value of each flag to the
+  // MICRO_FLAG_OFFSET at the same position in [offsets]. The table
+  // does not point to any variable and can be shared by all parses,
+  // see micro_flag_context_init
+  std::array<MicroFlag, N> bind_offsets(const std::size_t (&offsets)[N]) const noexcept
+  {
+    void *values[N];
+    for (std::size_t i = 0; i < N; ++i)
+      values[i] = reinterpret_cast<void*>(offsets[i]);
+    return bind(values);
+  }
+
+  // Create a MicroFlagSet on [flags] that uses this index. Neither
+  // [flags] nor the index are copied, they must outlive the set.
+  // Nothing is allocated, calling micro_flag_free is not needed.
+  MicroFlagSet set(const MicroFlag *flags) const noexcept
+  {
+    MicroFlagSet set;
+    micro_flag_compile_with(&set, flags, static_cast<unsigned int>(N),
+                            &index::lookup_fn, this);
+    return set;
+  }
+
+private:
+  static constexpr std::size_t max_keys    = 2 * N;
+  static constexpr std::size_t num_buckets = N;
+  static constexpr std::uint32_t max_seed  = 1u << 20;
+
+  struct key {
+    const char *name = nullptr;
+    std::size_t len = 0;
+    std::uint64_t hash = 0;
+    int flag = -1;
+  };
+
+  constexpr void add_key(const char *name, int flag)
+  {
+    key &k = keys_[num_keys_++];
+    k.name = name;
+    k.len  = detail::length(name);
+    k.hash = detail::hash(name, k.len);
+    k.flag = flag;
+  }
+
+  // Hash and displace: split the keys in buckets, then starting from
+  // the biggest bucket find a seed that moves all of its keys to free
+  // slots. Keys with the same name always land in the same bucket,
+  // so duplicates are found while grouping them
+  constexpr void build()
+  {
+    std::array<std::size_t, num_buckets + 1> start{};
+    std::array<std::size_t, max_keys> members{};
+    std::array<std::size_t, num_buckets> order{};
+    std::array<bool, max_keys> taken{};
+
+    for (std::size_t i = 0; i < num_keys_; ++i)
+      ++start[bucket_of(keys_[i]) + 1];
+    for (std::size_t b = 0; b < num_buckets; ++b)
+      start[b + 1] += start[b];
+    std::array<std::size_t, num_buckets> fill{};
+    for (std::size_t i = 0; i < num_keys_; ++i)
+    {
+      std::size_t b = bucket_of(keys_[i]);
+      for (std::size_t m = start[b]; m < start[b] + fill[b]; ++m)
+        if (detail::equal(keys_[members[m]].name, keys_[members[m]].len,
+                          keys_[i].name, keys_[i].len))
+          throw "micro_flag::index: duplicate flag name";
+      members[start[b] + fill[b]++] = i;
+    }
+
+    for (std::size_t b = 0; b < num_buckets; ++b)
+    {
+      std::size_t size = start[b + 1] - start[b];
+      std::size_t j = b;
+      for (; j > 0 && start[order[j - 1] + 1] - start[order[j - 1]] < size; --j)
+        order[j] = order[j - 1];
+      order[j] = b;
+    }
+
+    for (std::size_t o = 0; o < num_buckets; ++o)
+    {
+      std::size_t first = start[order[o]], last = start[order[o] + 1];
+      if (first == last)
+        break;
+      std::uint32_t seed = 1;
+      while (!try_seed(members, first, last, seed, taken))
+        if (++seed == max_seed)
+          throw "micro_flag::index: could not build the perfect hash";
+      seeds_[order[o]] = seed;
+    }
+  }
+
+  constexpr std::size_t bucket_of(const key &k) const
+  {
+    return detail::mix(k.hash, 0) % num_buckets;
+  }
+
+  constexpr bool try_seed(const std::array<std::size_t, max_keys> &members,
+                          std::size_t first, std::size_t last,
+                          std::uint32_t seed,
+                          std::array<bool, max_keys> &taken)
+  {
+    for (std::size_t m = first; m < last; ++m)
+    {
+      std::size_t pos = detail::mix(keys_[members[m]].hash, seed) % num_keys_;
+      if (taken[pos])
+      {
+        for (std::size_t u = first; u < m; ++u)
+          taken[detail::mix(keys_[members[u]].hash, seed) % num_keys_] = false;
+        return false;
+      }
+      taken[pos] = true;
+      slots_[pos] = keys_[members[m]];
+    }
+    return true;
+  }
+
+  static int lookup_fn(const MicroFlagSet *set, const char *name,
+                       std::size_t len)
+  {
+    return static_cast<const index*>(set->lookup_data)->lookup(name, len);
+  }
+
+  std::array<spec, N> specs_{};
+  std::array<key, max_keys> keys_{};
+  std::array<key, max_keys> slots_{};
+  std::array<std::uint32_t, num_buckets> seeds_{};
+  std::size_t num_keys_ = 0;
+};
+
+// Build the index of [specs], use it to initialize a constexpr variable
+// so that it is computed at compile time
+template <std::size_t N>
+constexpr index<N> make_index(const spec (&specs)[N])
+{
+  return index<N>(specs);
+}
+
+} // namespace micro_flag
+
+#endif // _MICRO_FLAG_HPP_
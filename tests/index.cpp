@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+//
+// The compile time index of micro-flag.hpp, alone and under the trie
+// and SIMD lookups, which fall back to it for the names they do not
+// hold:
+//
+//   make test
+//   ./tests/index
+
+#define MICRO_FLAG_IMPLEMENTATION
+#include "micro-flag.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+static constexpr micro_flag::spec specs[] =
+  {
+    { MICRO_FLAG_BOOL, "-h", "--help",   "show help message" },
+    { MICRO_FLAG_STR,  "-o", "--output", "set output file"   },
+    { MICRO_FLAG_INT,  "-n", "--a-number-with-a-name-over-32-bytes",
+                             "print this number" },
+  };
+static constexpr auto flag_index = micro_flag::make_index(specs);
+
+static_assert(flag_index.lookup("--output", 8) == 1, "long name");
+static_assert(flag_index.lookup("-n", 2) == 2, "short name");
+static_assert(flag_index.lookup("--out", 5) == -1, "no abbreviations");
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  if (!ok)
+  {
+    std::fprintf(stderr, "index: %s failed\n", what);
+    failures++;
+  }
+}
+
+int main()
+{
+  bool show_help = false;
+  char *out_name = nullptr;
+  int a_number = 0;
+  auto flags = flag_index.bind({ &show_help, &out_name, &a_number });
+
+  const char *names[] = { "index", "trie", "simd" };
+  for (int mode = 0; mode < 3; ++mode)
+  {
+    MicroFlagSet set = flag_index.set(flags.data());
+    if (mode == 1)
+      check(micro_flag_compile_trie(&set) == MICRO_FLAG_OK, names[mode]);
+    if (mode == 2)
+      check(micro_flag_compile_simd(&set) == MICRO_FLAG_OK, names[mode]);
+
+    const char *long_name = "--a-number-with-a-name-over-32-bytes";
+    check(micro_flag_lookup(&set, long_name, std::strlen(long_name)) == 2,
+          names[mode]);
+    check(micro_flag_lookup(&set, "-o", 2) == 1, names[mode]);
+    check(micro_flag_lookup(&set, "--unknown-name-also-longer-than-32", 34) == -1,
+          names[mode]);
+
+    char arg0[] = "index", arg1[] = "-h", arg2[] = "-n", arg3[] = "42",
+      arg4[] = "--output=file";
+    char *argv[] = { arg0, arg1, arg2, arg3, arg4 };
+    show_help = false;
+    a_number = 0;
+    check(micro_flag_parse_set(&set, 5, argv) == MICRO_FLAG_OK
+          && show_help && a_number == 42
+          && std::strcmp(out_name, "file") == 0, names[mode]);
+    micro_flag_free(&set);
+  }
+
+  std::printf("index: 3 lookups, %d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: MIT
+//
+// Differential test of micro_flag_parse_int and micro_flag_parse_double
+// against strtol and strtod. Random and edge case strings are parsed
+// by both, which must agree on whether each string is a number and,
+// bit for bit, on its value:
+//
+//   make test
+//   ./tests/numbers [cases]
+//
+// micro-flag.h accepts only whole strings and rejects what strtol and
+// strtod parse only partly, like "12abc" or " 12". A double too small
+// for its type rounds to a denormal or zero in both, but strtod also
+// sets ERANGE, which is not an error for micro-flag.h; one too large
+// is an error for both.
+
+#define MICRO_FLAG_IMPLEMENTATION
+#include "micro-flag.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *int_cases[] = {
+  "0", "-0", "+0", "1", "-1", "2147483647", "-2147483648", "2147483648",
+  "-2147483649", "000000000000002147483647", "-00000000002147483648",
+  "99999999999", "12345678", "123456789", "1234567890", "", "-", "+",
+  "--1", "+-1", " 1", "1 ", "12abc", "0x10", "1e3",
+};
+
+static const char *double_cases[] = {
+  "0", "-0", "0.0", ".5", "5.", ".", "1e", "1e+", "1e-", "e5", "1.5e3",
+  "123.123", "1e-3", "0.1", "0.3", "1e22", "1e23", "9007199254740993",
+  "2.2250738585072011e-308", "2.2250738585072014e-308",
+  "4.9406564584124654e-324", "2.4703282292062327e-324",
+  "2.4703282292062328e-324", "1e-400", "1.7976931348623157e308",
+  "1.7976931348623158e308", "1.7976931348623159e308", "1e309",
+  "inf", "-inf", "Infinity", "nan", "-NaN", "0x1p3", " 1", "1 ", "1.5x",
+  "00000000000000000000000000000001.5", "1e0000000000000000000000000000005",
+  "0.000000000000000000000000000000000000000000000000000000000001e60",
+};
+
+static uint64_t test_random(uint64_t *state)
+{
+  // xorshift64, so that every run tests the same strings
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// Append [count] random digits to [buf] at [len]
+static size_t test_digits(char *buf, size_t len, int count, uint64_t *state)
+{
+  for (int i = 0; i < count; ++i)
+    buf[len++] = (char) ('0' + test_random(state) % 10);
+  return len;
+}
+
+// Random integer like string of at most 40 bytes in [buf]
+static void test_random_int(char *buf, uint64_t *state)
+{
+  size_t len = 0;
+  uint64_t r = test_random(state);
+  if (r % 3 == 0)
+    buf[len++] = (r % 2) ? '-' : '+';
+  if (r % 7 == 0)
+    buf[len++] = '0';
+  len = test_digits(buf, len, (int) (test_random(state) % 13), state);
+  // Sometimes a byte that is not a digit
+  if (r % 11 == 0 && len > 0)
+    buf[test_random(state) % len] = "x. e-"[test_random(state) % 5];
+  buf[len] = '\0';
+}
+
+// Random decimal string of at most 900 bytes in [buf]
+static void test_random_double(char *buf, uint64_t *state)
+{
+  uint64_t r = test_random(state);
+  switch (r % 4)
+  {
+  case 0:
+  {
+    // Shortest and longer forms of a random double
+    uint64_t bits = test_random(state);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (value != value || value - value != 0)
+      value = 1.0 / (double) (bits | 1);
+    snprintf(buf, 64, "%.*e", (int) (test_random(state) % 25), value);
+    break;
+  }
+  case 1:
+  {
+    // Halfway between two doubles, the hardest to round
+    uint64_t bits = test_random(state) >> 2;
+    double lo, hi;
+    memcpy(&lo, &bits, sizeof(lo));
+    bits++;
+    memcpy(&hi, &bits, sizeof(hi));
+    snprintf(buf, 900, "%.*e", 750 + (int) (test_random(state) % 50),
+             lo / 2 + hi / 2);
+    break;
+  }
+  default:
+  {
+    size_t len = 0;
+    if (r % 5 == 0)
+      buf[len++] = '-';
+    len = test_digits(buf, len, (int) (test_random(state) % 25), state);
+    if (r % 3 != 0)
+    {
+      buf[len++] = '.';
+      len = test_digits(buf, len, (int) (test_random(state) % 25), state);
+    }
+    if (r % 2 == 0)
+    {
+      buf[len++] = 'e';
+      if (r % 4 == 0)
+        buf[len++] = '-';
+      len = test_digits(buf, len, 1 + (int) (test_random(state) % 3), state);
+    }
+    buf[len] = '\0';
+    break;
+  }
+  }
+}
+
+// Compare micro_flag_parse_int with strtol on [str]
+//
+// Returns: true if they agree
+static bool test_int(const char *str)
+{
+  size_t len = strlen(str);
+  char *end;
+  errno = 0;
+  long expected = strtol(str, &end, 10);
+  bool ok = len > 0 && end == str + len && errno == 0
+    && str[0] != ' ' && expected >= INT_MIN && expected <= INT_MAX;
+
+  int value = 0;
+  MicroFlagError err = micro_flag_parse_int(str, len, &value);
+  if ((err == MICRO_FLAG_OK) == ok && (!ok || value == expected))
+    return true;
+  fprintf(stderr, "int \"%s\": strtol %s %ld, micro_flag_parse_int %s %d\n",
+          str, ok ? "ok" : "error", expected,
+          err == MICRO_FLAG_OK ? "ok" : "error", value);
+  return false;
+}
+
+// Compare micro_flag_parse_double with strtod on [str]
+//
+// Returns: true if they agree
+static bool test_double(const char *str)
+{
+  size_t len = strlen(str);
+  char *end;
+  errno = 0;
+  double expected = strtod(str, &end);
+  bool overflow = errno == ERANGE && (expected > 1 || expected < -1);
+  bool ok = len > 0 && end == str + len && !overflow && str[0] != ' '
+    && strchr(str, 'x') == NULL && strchr(str, 'X') == NULL;
+
+  double value = 0;
+  MicroFlagError err = micro_flag_parse_double(str, len, &value);
+  bool same = memcmp(&value, &expected, sizeof(value)) == 0
+    || (value != value && expected != expected);
+  if ((err == MICRO_FLAG_OK) == ok && (!ok || same))
+    return true;
+  fprintf(stderr, "double \"%s\": strtod %s %.17g, "
+          "micro_flag_parse_double %s %.17g\n",
+          str, ok ? "ok" : "error", expected,
+          err == MICRO_FLAG_OK ? "ok" : "error", value);
+  return false;
+}
+
+int main(int argc, char** argv)
+{
+  long cases = argc > 1 ? strtol(argv[1], NULL, 10) : 200000;
+  unsigned long failures = 0;
+
+  for (size_t i = 0; i < sizeof(int_cases) / sizeof(int_cases[0]); ++i)
+    failures += !test_int(int_cases[i]);
+  for (size_t i = 0; i < sizeof(double_cases) / sizeof(double_cases[0]); ++i)
+    failures += !test_double(double_cases[i]);
+
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+  char buf[1024];
+  for (long i = 0; i < cases && failures < 10; ++i)
+  {
+    test_random_int(buf, &state);
+    failures += !test_int(buf);
+    test_random_double(buf, &state);
+    failures += !test_double(buf);
+  }
+
+  printf("numbers: %ld random ints and doubles, %lu mismatches\n",
+         cases, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,876 @@
+// SPDX-License-Identifier: MIT
+//
+// Behavior tests of the parse sources of micro-flag.h and of the
+// features built on them. Each test checks the main path and the
+// documented error path of one feature. Temporary files are written
+// next to this file and removed at the end:
+//
+//   make test
+//   ./tests/parse
+
+#define MICRO_FLAG_IMPLEMENTATION
+#include "micro-flag.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TEST_CONF "tests/parse-conf.tmp"
+#define TEST_RSP_A "tests/parse-a.tmp"
+#define TEST_RSP_B "tests/parse-b.tmp"
+#define TEST_CACHE "tests/parse-cache.tmp"
+
+static int cases = 0;
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  cases++;
+  if (!ok)
+  {
+    failures++;
+    fprintf(stderr, "parse: %s\n", what);
+  }
+}
+
+// Write [data] to the file at [path]
+static void write_file(const char *path, const char *data)
+{
+  FILE *file = fopen(path, "w");
+  check(file != NULL, "cannot write a temporary file");
+  if (file == NULL)
+    return;
+  fputs(data, file);
+  fclose(file);
+}
+
+// Short flags cluster, take attached values, and a cluster with an
+// unknown flag or a bad value sets none of its flags
+static void test_cluster(void)
+{
+  bool x = false, v = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &x,      "-x", NULL,       "" },
+      { MICRO_FLAG_BOOL, &v,      "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number, "-n", "--number", "" },
+      { MICRO_FLAG_STR,  &out,    "-o", "--output", "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 4) == MICRO_FLAG_OK, "cluster: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  char *argv[] = { "parse", "-xvn42", "-ofile" };
+  check(micro_flag_parse_r(&set, &ctx, 3, argv) == MICRO_FLAG_OK
+        && x && v && number == 42 && strcmp(out, "file") == 0,
+        "cluster: -xvn42 -ofile");
+
+  x = v = false;
+  number = 0;
+  char *next[] = { "parse", "-vxn", "7" };
+  check(micro_flag_parse_r(&set, &ctx, 3, next) == MICRO_FLAG_OK
+        && x && v && number == 7, "cluster: value in the next argument");
+
+  x = v = false;
+  char *unknown[] = { "parse", "-xz" };
+  check(micro_flag_parse_r(&set, &ctx, 2, unknown)
+        == MICRO_FLAG_ERROR_UNKNOWN_FLAG && !x, "cluster: -xz set -x");
+  ctx.ignore_unknown = true;
+  check(micro_flag_parse_r(&set, &ctx, 2, unknown) == MICRO_FLAG_OK && !x,
+        "cluster: ignored -xz set -x");
+  ctx.ignore_unknown = false;
+
+  char *bad[] = { "parse", "-xvn4a" };
+  check(micro_flag_parse_r(&set, &ctx, 2, bad) == MICRO_FLAG_ERROR_NOT_AN_INT
+        && !x && !v, "cluster: bad attached value set the booleans");
+
+  micro_flag_free(&set);
+}
+
+// "--name=value" matches the name up to the '=' and points the value
+// into the argument; booleans take no value
+static void test_equals(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK, "equals: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  char *argv[] = { "parse", "--number=-3", "--output=a=b", "--verbose" };
+  check(micro_flag_parse_r(&set, &ctx, 4, argv) == MICRO_FLAG_OK
+        && number == -3 && verbose && strcmp(out, "a=b") == 0
+        && out == argv[2] + 9, "equals: values not set in place");
+
+  char *empty[] = { "parse", "--output=" };
+  check(micro_flag_parse_r(&set, &ctx, 2, empty) == MICRO_FLAG_OK
+        && strcmp(out, "") == 0, "equals: empty value");
+
+  char *boolean[] = { "parse", "--verbose=yes" };
+  check(micro_flag_parse_r(&set, &ctx, 2, boolean)
+        == MICRO_FLAG_ERROR_UNEXPECTED_VALUE && ctx.diag.index == 1,
+        "equals: value given to a boolean");
+
+  char *prefix[] = { "parse", "--out=x" };
+  check(micro_flag_parse_r(&set, &ctx, 2, prefix)
+        == MICRO_FLAG_ERROR_UNKNOWN_FLAG, "equals: name matched as a prefix");
+
+  char *bad[] = { "parse", "--number=4x" };
+  check(micro_flag_parse_r(&set, &ctx, 2, bad) == MICRO_FLAG_ERROR_NOT_AN_INT,
+        "equals: bad value accepted");
+
+  micro_flag_free(&set);
+}
+
+// Messages go to the sink given, whole or truncated, and never to
+// stdout or stderr
+static void test_sink(void)
+{
+  char c = 0;
+  int number = 0;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_CHAR, &c,      "-c", NULL,       "" },
+      { MICRO_FLAG_INT,  &number, "-n", "--number", "" },
+      { MICRO_FLAG_INT,  &number, "-m", "--number", "" },
+    };
+  MicroFlagSet set;
+  char buf[256];
+  MicroFlagSink sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  check(micro_flag_compile_r(&set, flags, 3, &sink)
+        == MICRO_FLAG_ERROR_DUPLICATE_FLAG
+        && strcmp(buf, "Error compiling flags: duplicate flag \"--number\"\n") == 0,
+        "sink: duplicate not written to the sink");
+  check(micro_flag_compile_r(&set, flags, 2, NULL) == MICRO_FLAG_OK,
+        "sink: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  // Short only flags are named by their short name
+  char *usage[] = { "parse", "-c", "xy" };
+  sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  check(micro_flag_parse_r(&set, &ctx, 3, usage)
+        == MICRO_FLAG_ERROR_CHAR_WRONG_ARG, "sink: bad char accepted");
+  micro_flag_write_error(&sink, &ctx.diag);
+  check(strcmp(buf, "Usage: -c <char>\n") == 0 && !sink.truncated,
+        "sink: usage of a short only flag");
+
+  char *unknown[] = { "parse", "--unknown-flag" };
+  micro_flag_parse_r(&set, &ctx, 2, unknown);
+  char small[16];
+  sink = micro_flag_sink_buffer(small, sizeof(small));
+  micro_flag_write_error(&sink, &ctx.diag);
+  check(sink.truncated && sink.len == sizeof(small) - 1
+        && strncmp(small, "Error parsing f", sizeof(small)) == 0,
+        "sink: long message not truncated");
+
+  int fds[2];
+  check(pipe(fds) == 0, "sink: pipe");
+  sink = micro_flag_sink_fd(fds[1]);
+  micro_flag_write_error(&sink, &ctx.diag);
+  close(fds[1]);
+  ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  buf[len > 0 ? len : 0] = '\0';
+  check(strcmp(buf, "Error parsing flags: unknown flag \"--unknown-flag\"\n") == 0,
+        "sink: file descriptor message");
+
+  sink = micro_flag_sink_silent();
+  micro_flag_write_error(&sink, &ctx.diag);
+  micro_flag_free(&set);
+}
+
+// Write the [len] bytes of [data] to a pipe and return its read end
+static int pipe_of(const char *data, size_t len)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+    return -1;
+  check(write(fds[1], data, len) == (ssize_t) len, "cannot fill a pipe");
+  close(fds[1]);
+  return fds[0];
+}
+
+// Null separated arguments are read through a window smaller than
+// the input, with string values copied to a pool
+static void test_stream(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL, *name = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+      { MICRO_FLAG_STR,  &name,    "-N", "--name",    "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 4) == MICRO_FLAG_OK, "stream: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+  char strings[64];
+  micro_flag_context_strings(&ctx, strings, sizeof(strings));
+
+  static const char input[] = "-n\0-42\0--output\0file.txt\0-N\0a name\0-v";
+  char window[12];
+  int fd = pipe_of(input, sizeof(input) - 1);
+  check(micro_flag_parse_stream(&set, &ctx, fd, window, sizeof(window))
+        == MICRO_FLAG_OK && number == -42 && verbose
+        && strcmp(out, "file.txt") == 0 && strcmp(name, "a name") == 0
+        && out >= strings && out < strings + sizeof(strings),
+        "stream: values not parsed through the window");
+  close(fd);
+
+  char tiny[6];
+  fd = pipe_of(input, sizeof(input) - 1);
+  check(micro_flag_parse_stream(&set, &ctx, fd, tiny, sizeof(tiny))
+        == MICRO_FLAG_ERROR_TOO_LONG && ctx.diag.index == 3,
+        "stream: argument longer than the window accepted");
+  close(fd);
+
+  micro_flag_context_strings(&ctx, strings, 8);
+  fd = pipe_of(input, sizeof(input) - 1);
+  check(micro_flag_parse_stream(&set, &ctx, fd, window, sizeof(window))
+        == MICRO_FLAG_ERROR_NO_SPACE, "stream: full string pool accepted");
+  close(fd);
+
+  static const char dangling[] = "-v\0-n";
+  micro_flag_context_strings(&ctx, strings, sizeof(strings));
+  fd = pipe_of(dangling, sizeof(dangling) - 1);
+  check(micro_flag_parse_stream(&set, &ctx, fd, window, sizeof(window))
+        == MICRO_FLAG_ERROR_MISSING_INT, "stream: missing value accepted");
+  close(fd);
+
+  micro_flag_free(&set);
+}
+
+#ifdef MICRO_FLAG_LINUX
+
+typedef struct {
+  int pid;
+  int *number;
+  int found;
+} ProcScan;
+
+// Keep the value of the flag of the process looked for, and reset it
+// for the next process
+static int proc_scan_fn(int pid, MicroFlagContext *ctx, void *data)
+{
+  ProcScan *scan = (ProcScan*) data;
+  if (pid == scan->pid && ctx->diag.error == MICRO_FLAG_OK)
+    scan->found = *scan->number;
+  *scan->number = 0;
+  return 0;
+}
+
+// The command line of a child shell is read from /proc, picking only
+// the flags of the set, by pid and by a scan of every process
+static void test_proc(void)
+{
+  int number = 0;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_INT, &number, "-n", "--number", "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 1) == MICRO_FLAG_OK, "proc: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+  ctx.ignore_unknown = true;
+  char buf[4096];
+
+  // The child waits on a pipe until the parent closes it
+  int fds[2];
+  check(pipe(fds) == 0, "proc: pipe");
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    dup2(fds[0], 0);
+    close(fds[1]);
+    execlp("sh", "sh", "-c", "read line", "sh", "--number", "7", (char*) NULL);
+    _exit(1);
+  }
+  close(fds[0]);
+
+  // Until it has called exec, the child has the command line of this test
+  time_t start = time(NULL);
+  while (number != 7 && time(NULL) - start < 5)
+    micro_flag_parse_proc(&set, &ctx, (int) pid, buf, sizeof(buf));
+  check(number == 7, "proc: flag of the child not found");
+
+  ProcScan scan = { (int) pid, &number, 0 };
+  number = 0;
+  check(micro_flag_scan_procs(&set, &ctx, buf, sizeof(buf), proc_scan_fn, &scan)
+        == MICRO_FLAG_OK && scan.found == 7, "proc: child not found by the scan");
+
+  check(micro_flag_parse_proc(&set, &ctx, (int) pid, buf, 8)
+        == MICRO_FLAG_ERROR_TOO_LONG, "proc: small buffer accepted");
+  close(fds[1]);
+  waitpid(pid, NULL, 0);
+  check(micro_flag_parse_proc(&set, &ctx, (int) pid, buf, sizeof(buf))
+        == MICRO_FLAG_ERROR_IO, "proc: exited process read");
+
+  micro_flag_free(&set);
+}
+
+#endif // MICRO_FLAG_LINUX
+
+// Response files expand in place, nest, and report their errors, a
+// cycle among them included, at the index of their "@path" argument
+static void test_response(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK, "response: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+  ctx.response_files = true;
+
+  write_file(TEST_RSP_A, "-o 'a b'\n@" TEST_RSP_B "\n");
+  write_file(TEST_RSP_B, "--number 5\n");
+  char *argv[] = { "parse", "@" TEST_RSP_A, "-v" };
+  check(micro_flag_parse_r(&set, &ctx, 3, argv) == MICRO_FLAG_OK
+        && verbose && number == 5 && strcmp(out, "a b") == 0,
+        "response: nested files not expanded");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_RSP_B, "-n 1 @" TEST_RSP_A "\n");
+  char *cycle[] = { "parse", "-v", "@" TEST_RSP_A };
+  check(micro_flag_parse_r(&set, &ctx, 3, cycle)
+        == MICRO_FLAG_ERROR_INCLUDE_CYCLE && ctx.diag.index == 2,
+        "response: include cycle accepted");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_RSP_B, "-n x\n");
+  char *bad[] = { "parse", "@" TEST_RSP_B, "-v" };
+  check(micro_flag_parse_r(&set, &ctx, 3, bad) == MICRO_FLAG_ERROR_NOT_AN_INT
+        && ctx.diag.index == 1, "response: error not at the \"@path\" index");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_RSP_B, "-v --output");
+  char *pending[] = { "parse", "@" TEST_RSP_B, "c" };
+  check(micro_flag_parse_r(&set, &ctx, 3, pending) == MICRO_FLAG_OK
+        && strcmp(out, "c") == 0, "response: value after the file not taken");
+  micro_flag_context_release(&ctx);
+
+  char *missing[] = { "parse", "-v", "@tests/missing.rsp" };
+  check(micro_flag_parse_r(&set, &ctx, 3, missing) == MICRO_FLAG_ERROR_IO
+        && ctx.diag.index == 2, "response: missing file accepted");
+  micro_flag_context_release(&ctx);
+
+  ctx.response_files = false;
+  char *off[] = { "parse", "@" TEST_RSP_B };
+  check(micro_flag_parse_r(&set, &ctx, 2, off) == MICRO_FLAG_ERROR_UNKNOWN_FLAG,
+        "response: file expanded when not enabled");
+
+  micro_flag_free(&set);
+}
+
+// Config files set flags by whole long names, report errors at
+// their line, and ignore the abbreviations of a trie
+static void test_config(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK
+        && micro_flag_compile_trie(&set) == MICRO_FLAG_OK, "config: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  write_file(TEST_CONF, "# comment\r\n; comment\n\n  verbose = yes\r\n"
+             "number=12\noutput = \"a b\"  \n");
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF) == MICRO_FLAG_OK
+        && verbose && number == 12 && strcmp(out, "a b") == 0,
+        "config: values not set");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_CONF, "number = 1\nout = x\n");
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF)
+        == MICRO_FLAG_ERROR_UNKNOWN_FLAG && ctx.diag.index == 2,
+        "config: abbreviated key accepted");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_CONF, "number = 1\n\nverbose\n");
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF)
+        == MICRO_FLAG_ERROR_SYNTAX && ctx.diag.index == 3,
+        "config: line without '=' accepted");
+  micro_flag_context_release(&ctx);
+
+  write_file(TEST_CONF, "verbose = maybe\n");
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF)
+        == MICRO_FLAG_ERROR_NOT_A_BOOL, "config: bad bool accepted");
+  micro_flag_context_release(&ctx);
+
+  check(micro_flag_parse_config(&set, &ctx, "tests/missing.conf")
+        == MICRO_FLAG_ERROR_IO, "config: missing file accepted");
+  micro_flag_context_release(&ctx);
+  micro_flag_free(&set);
+}
+
+// Variables with the prefix set flags by their long name, others are
+// ignored, and errors are reported at the index of the variable
+static void test_env(void)
+{
+  bool dry_run = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &dry_run, "-d", "--dry-run", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK
+        && micro_flag_compile_trie(&set) == MICRO_FLAG_OK, "env: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  char *envp[] =
+    {
+      "HOME=/root", "APP_DRY_RUN=yes", "APP_Number=8", "APP_OUT=x",
+      "APP_VERBOSE=1", "APP_=1", "APP_OUTPUT=a=b", "NUMBER=9", NULL
+    };
+  check(micro_flag_parse_env(&set, &ctx, "APP_", envp) == MICRO_FLAG_OK
+        && dry_run && number == 8 && strcmp(out, "a=b") == 0
+        && out == envp[6] + 11, "env: values not set in place");
+
+  char *off[] = { "APP_DRY_RUN=off", NULL };
+  check(micro_flag_parse_env(&set, &ctx, "APP_", off) == MICRO_FLAG_OK
+        && !dry_run, "env: false boolean");
+
+  char *bad_bool[] = { "APP_NUMBER=1", "APP_DRY_RUN=maybe", NULL };
+  check(micro_flag_parse_env(&set, &ctx, "APP_", bad_bool)
+        == MICRO_FLAG_ERROR_NOT_A_BOOL && ctx.diag.index == 1,
+        "env: bad bool accepted");
+
+  char *bad_int[] = { "APP_NUMBER=4x", NULL };
+  check(micro_flag_parse_env(&set, &ctx, "APP_", bad_int)
+        == MICRO_FLAG_ERROR_NOT_AN_INT && ctx.diag.index == 0,
+        "env: bad int accepted");
+
+  micro_flag_free(&set);
+}
+
+// Words split at spaces, tabs and newlines only, with the quotes and
+// backslashes of the shell
+static void test_string(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "" },
+      { MICRO_FLAG_INT,  &number,  "-n", "--number",  "" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK, "string: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  static const struct {
+    const char *str;
+    const char *out;
+  } cases[] =
+    {
+      { "prog -o 'a b' -n 4 -v",                  "a b" },
+      { "prog\t-o\n\"x\\\"y\\\\z $\" -v -n 4",     "x\"y\\z $" },
+      { "prog -o a\\ b\\'c -n 4 -v",              "a b'c" },
+      { "prog -o ab\\\ncd -n 4 -v",               "abcd" },
+      { "prog -o 'it''s' -n 4 -v",                "its" },
+      { "prog -o a\vb\rc\fd -n 4 -v",             "a\vb\rc\fd" },
+      { "prog -o a_long_value_past_sixteen_bytes_\"with quotes\" -n 4 -v",
+        "a_long_value_past_sixteen_bytes_with quotes" },
+    };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+  {
+    char buf[128];
+    strcpy(buf, cases[i].str);
+    verbose = false;
+    number = 0;
+    out = NULL;
+    check(micro_flag_parse_string(&set, &ctx, buf) == MICRO_FLAG_OK
+          && verbose && number == 4 && out != NULL
+          && strcmp(out, cases[i].out) == 0, "string: bad split");
+  }
+
+  char open_quote[] = "prog -o 'abc";
+  check(micro_flag_parse_string(&set, &ctx, open_quote)
+        == MICRO_FLAG_ERROR_UNTERMINATED, "string: open quote accepted");
+  char arena[8];
+  check(micro_flag_parse_string_copy(&set, &ctx, "prog -o value", arena,
+                                     sizeof(arena))
+        == MICRO_FLAG_ERROR_NO_SPACE, "string: small arena accepted");
+  check(micro_flag_parse_string_copy(&set, &ctx, "p -o x", arena,
+                                     sizeof(arena)) == MICRO_FLAG_OK
+        && strcmp(out, "x") == 0 && out >= arena && out < arena + 8,
+        "string: copy does not point into the arena");
+
+  micro_flag_free(&set);
+}
+
+#ifdef MICRO_FLAG_ATOMICS
+
+typedef struct {
+  int batch;
+  double ratio;
+  char *name;
+  int plain;
+} Tuning;
+
+// Atomic flags are changed after the parse, through pointers or in
+// the struct of an offset table, and other flags are refused
+static void test_atomic(void)
+{
+  int batch = 0;
+  double ratio = 0;
+  char *name = NULL;
+  int plain = 0;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_ATOMIC_INT,    &batch, "-b", "--batch", "" },
+      { MICRO_FLAG_ATOMIC_DOUBLE, &ratio, "-r", "--ratio", "" },
+      { MICRO_FLAG_ATOMIC_STR,    &name,  "-N", "--name",  "" },
+      { MICRO_FLAG_INT,           &plain, "-p", "--plain", "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 4) == MICRO_FLAG_OK, "atomic: compile");
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+
+  char *argv[] = { "parse", "-b", "8", "--ratio", "0.5", "--name", "a" };
+  check(micro_flag_parse_r(&set, &ctx, 7, argv) == MICRO_FLAG_OK
+        && micro_flag_load_int(&batch) == 8
+        && micro_flag_load_double(&ratio) == 0.5
+        && strcmp(micro_flag_load_str(&name), "a") == 0, "atomic: parse");
+  check(micro_flag_set(&set, NULL, "--batch", "64") == MICRO_FLAG_OK
+        && micro_flag_set(&set, NULL, "--ratio", "2.25") == MICRO_FLAG_OK
+        && micro_flag_set(&set, NULL, "--name", "b") == MICRO_FLAG_OK
+        && micro_flag_load_int(&batch) == 64
+        && micro_flag_load_double(&ratio) == 2.25
+        && strcmp(micro_flag_load_str(&name), "b") == 0,
+        "atomic: values not set");
+  check(micro_flag_set(&set, NULL, "--batch", "6x")
+        == MICRO_FLAG_ERROR_NOT_AN_INT && micro_flag_load_int(&batch) == 64,
+        "atomic: bad value stored");
+  check(micro_flag_set(&set, NULL, "--plain", "1")
+        == MICRO_FLAG_ERROR_NOT_ATOMIC && plain == 0, "atomic: plain flag set");
+  check(micro_flag_set(&set, NULL, "--missing", "1")
+        == MICRO_FLAG_ERROR_UNKNOWN_FLAG, "atomic: unknown flag set");
+  micro_flag_free(&set);
+
+  // The same flags as an offset table write to the struct given
+  MicroFlag offsets[] =
+    {
+      { MICRO_FLAG_ATOMIC_INT,    MICRO_FLAG_OFFSET(Tuning, batch), "-b",
+                                  "--batch", "" },
+      { MICRO_FLAG_ATOMIC_DOUBLE, MICRO_FLAG_OFFSET(Tuning, ratio), "-r",
+                                  "--ratio", "" },
+      { MICRO_FLAG_ATOMIC_STR,    MICRO_FLAG_OFFSET(Tuning, name),  "-N",
+                                  "--name",  "" },
+      { MICRO_FLAG_INT,           MICRO_FLAG_OFFSET(Tuning, plain), "-p",
+                                  "--plain", "" },
+    };
+  check(micro_flag_compile(&set, offsets, 4) == MICRO_FLAG_OK,
+        "atomic: compile offsets");
+  Tuning tuning;
+  memset(&tuning, 0, sizeof(tuning));
+  check(micro_flag_set(&set, &tuning, "--batch", "32") == MICRO_FLAG_OK
+        && micro_flag_set(&set, &tuning, "--name", "c") == MICRO_FLAG_OK
+        && micro_flag_load_int(&tuning.batch) == 32
+        && strcmp(micro_flag_load_str(&tuning.name), "c") == 0,
+        "atomic: offset table not set in the struct");
+  micro_flag_free(&set);
+}
+
+#endif // MICRO_FLAG_ATOMICS
+
+// Lazy values of a config file survive the parse of argv, which
+// overrides them, and convert with the index of their source
+static void test_lazy(void)
+{
+  int level = 1, count = 2;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_INT, &level, "-l", "--level", "" },
+      { MICRO_FLAG_INT, &count, "-c", "--count", "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 2) == MICRO_FLAG_OK, "lazy: compile");
+
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, NULL);
+  MicroFlagLazy lazy[2];
+  micro_flag_context_lazy(&ctx, lazy, 2);
+
+  write_file(TEST_CONF, "level = 7\ncount = x\n");
+  char *argv[] = { "parse", "--count", "5" };
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF) == MICRO_FLAG_OK
+        && micro_flag_parse_r(&set, &ctx, 3, argv) == MICRO_FLAG_OK,
+        "lazy: layered parse fails");
+  check(level == 1 && count == 2, "lazy: values converted before access");
+  int value = 0;
+  check(micro_flag_get_int(&set, &ctx, "--level", &value) == MICRO_FLAG_OK
+        && value == 7 && level == 7, "lazy: config value lost after argv");
+  check(micro_flag_get_int(&set, &ctx, "--count", &value) == MICRO_FLAG_OK
+        && value == 5, "lazy: argv does not override config");
+
+  // The bad value is only seen when read, at its line
+  micro_flag_context_clear_lazy(&ctx);
+  char *none[] = { "parse" };
+  check(micro_flag_parse_config(&set, &ctx, TEST_CONF) == MICRO_FLAG_OK
+        && micro_flag_parse_r(&set, &ctx, 1, none) == MICRO_FLAG_OK,
+        "lazy: bad value checked during the parse");
+  check(micro_flag_get_int(&set, &ctx, "--count", &value)
+        == MICRO_FLAG_ERROR_NOT_AN_INT && ctx.diag.index == 2,
+        "lazy: bad value not reported at its line");
+
+  // Cleared slots fall back to the variables
+  micro_flag_context_clear_lazy(&ctx);
+  level = 3;
+  check(micro_flag_get_int(&set, &ctx, "--level", &value) == MICRO_FLAG_OK
+        && value == 3, "lazy: cleared slot still read");
+
+  micro_flag_context_release(&ctx);
+  micro_flag_free(&set);
+}
+
+typedef struct {
+  bool verbose;
+  char level;
+  int number;
+  double ratio;
+  char *out;
+} Cached;
+
+// Cached values come back as saved, and a blob for other inputs or
+// other flags, or a damaged one, sets nothing
+static void test_cache(void)
+{
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL,   MICRO_FLAG_OFFSET(Cached, verbose), "-v",
+                           "--verbose", "" },
+      { MICRO_FLAG_CHAR,   MICRO_FLAG_OFFSET(Cached, level),   "-l",
+                           "--level",   "" },
+      { MICRO_FLAG_INT,    MICRO_FLAG_OFFSET(Cached, number),  "-n",
+                           "--number",  "" },
+      { MICRO_FLAG_DOUBLE, MICRO_FLAG_OFFSET(Cached, ratio),   "-r",
+                           "--ratio",   "" },
+      { MICRO_FLAG_STR,    MICRO_FLAG_OFFSET(Cached, out),     "-o",
+                           "--output",  "" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 5) == MICRO_FLAG_OK, "cache: compile");
+  Cached saved = { true, 'x', -42, 0.125, "out file" };
+  check(micro_flag_cache_write(&set, &saved, 7, TEST_CACHE) == MICRO_FLAG_OK,
+        "cache: write");
+
+  Cached loaded;
+  memset(&loaded, 0, sizeof(loaded));
+  MicroFlagContext ctx;
+  micro_flag_context_init(&ctx, &loaded);
+  check(micro_flag_cache_load(&set, &ctx, 7, TEST_CACHE) == MICRO_FLAG_OK
+        && loaded.verbose && loaded.level == 'x' && loaded.number == -42
+        && loaded.ratio == 0.125 && strcmp(loaded.out, "out file") == 0,
+        "cache: values not loaded");
+  micro_flag_context_release(&ctx);
+
+  memset(&loaded, 0, sizeof(loaded));
+  check(micro_flag_cache_load(&set, &ctx, 8, TEST_CACHE)
+        == MICRO_FLAG_ERROR_STALE_CACHE && loaded.number == 0
+        && loaded.out == NULL, "cache: stale key accepted");
+  micro_flag_context_release(&ctx);
+
+  // Renaming a flag changes the hash of the set
+  MicroFlagSet renamed;
+  flags[2].long_name = "--count";
+  check(micro_flag_compile(&renamed, flags, 5) == MICRO_FLAG_OK
+        && micro_flag_cache_load(&renamed, &ctx, 7, TEST_CACHE)
+        == MICRO_FLAG_ERROR_STALE_CACHE && loaded.number == 0,
+        "cache: blob of other flags accepted");
+  micro_flag_context_release(&ctx);
+  micro_flag_free(&renamed);
+
+  char blob[512];
+  size_t len = 0;
+  check(micro_flag_cache_save(&set, &saved, 7, blob, 8, &len)
+        == MICRO_FLAG_ERROR_NO_SPACE && len > 8 && len <= sizeof(blob),
+        "cache: small buffer accepted");
+  check(micro_flag_cache_save(&set, &saved, 7, blob, sizeof(blob), &len)
+        == MICRO_FLAG_OK, "cache: save");
+  check(micro_flag_cache_apply(&set, &ctx, 7, blob, len - 1)
+        == MICRO_FLAG_ERROR_BAD_CACHE && loaded.number == 0,
+        "cache: truncated blob accepted");
+
+  write_file(TEST_CACHE, "not a cache blob, just some text of the same size");
+  check(micro_flag_cache_load(&set, &ctx, 7, TEST_CACHE)
+        == MICRO_FLAG_ERROR_BAD_CACHE && loaded.number == 0,
+        "cache: corrupt file accepted");
+  micro_flag_context_release(&ctx);
+
+  check(micro_flag_cache_load(&set, &ctx, 7, "tests/missing.cache")
+        == MICRO_FLAG_ERROR_IO, "cache: missing file accepted");
+  micro_flag_context_release(&ctx);
+  micro_flag_free(&set);
+}
+
+// The help is aligned, written whole or filtered by name or by text,
+// and requested by "--help" alone or with a filter
+static void test_help(void)
+{
+  bool verbose = false;
+  int number = 0;
+  char *out = NULL;
+  MicroFlag flags[] =
+    {
+      { MICRO_FLAG_BOOL, &verbose, "-v", "--verbose", "print more" },
+      { MICRO_FLAG_STR,  &out,     "-o", "--output",  "set output file" },
+      { MICRO_FLAG_INT,  &number,  NULL, "--a-very-long-name-that-wraps",
+                         "number of the output" },
+    };
+  MicroFlagSet set;
+  check(micro_flag_compile(&set, flags, 3) == MICRO_FLAG_OK, "help: compile");
+  MicroFlagHelp help;
+  check(micro_flag_help_render(&help, &set, "prog", "A test") == MICRO_FLAG_OK,
+        "help: render");
+
+  static const char header[] = "prog\nA test\n\nOptions:\n";
+  static const char line_v[] = "  -v, --verbose       print more\n";
+  static const char line_o[] = "  -o, --output <str>  set output file\n";
+  static const char line_n[] =
+    "      --a-very-long-name-that-wraps <int>\n"
+    "                      number of the output\n";
+  char buf[512], expected[512];
+  MicroFlagSink sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  snprintf(expected, sizeof(expected), "%s%s%s%s", header, line_v, line_o,
+           line_n);
+  check(micro_flag_help_write(&help, &sink, NULL) == 3
+        && strcmp(buf, expected) == 0, "help: columns not aligned");
+
+  MicroFlagSink full = micro_flag_sink_buffer(expected, sizeof(expected));
+  check(micro_flag_write_help(&full, "prog", "A test", flags, 3) == MICRO_FLAG_OK
+        && strcmp(buf, expected) == 0, "help: rendered help differs");
+
+  sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  snprintf(expected, sizeof(expected), "%s%s", header, line_o);
+  check(micro_flag_help_write(&help, &sink, "--output") == 1
+        && strcmp(buf, expected) == 0, "help: filter by name");
+
+  sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  snprintf(expected, sizeof(expected), "%s%s%s", header, line_o, line_n);
+  check(micro_flag_help_write(&help, &sink, "output") == 2
+        && strcmp(buf, expected) == 0, "help: filter by text");
+
+  sink = micro_flag_sink_buffer(buf, sizeof(buf));
+  check(micro_flag_help_write(&help, &sink, "--missing") == 0
+        && strcmp(buf, header) == 0, "help: filter matching nothing");
+
+  sink = micro_flag_sink_buffer(buf, 16);
+  check(micro_flag_help_write(&help, &sink, NULL) == 3 && sink.truncated
+        && strlen(buf) == 15, "help: small buffer overflowed");
+  micro_flag_help_free(&help);
+  micro_flag_free(&set);
+
+  // More matching lines apart than one write takes
+  static char names[130][8];
+  static MicroFlag many[130];
+  for (int i = 0; i < 130; ++i)
+  {
+    snprintf(names[i], sizeof(names[i]), "--f%03d", i);
+    MicroFlag f = { MICRO_FLAG_BOOL, &verbose, NULL, names[i],
+                    i % 2 == 0 ? "even" : "odd" };
+    many[i] = f;
+  }
+  check(micro_flag_compile(&set, many, 130) == MICRO_FLAG_OK
+        && micro_flag_help_render(&help, &set, "prog", "A test")
+        == MICRO_FLAG_OK, "help: render many");
+  static char big[8192], evens[8192];
+  size_t len = help.lines[0];
+  memcpy(evens, help.text, len);
+  for (unsigned int i = 0; i < set.num_flags; i += 2)
+  {
+    size_t line_len = help.lines[i + 1] - help.lines[i];
+    memcpy(evens + len, help.text + help.lines[i], line_len);
+    len += line_len;
+  }
+  evens[len] = '\0';
+  sink = micro_flag_sink_buffer(big, sizeof(big));
+  check(micro_flag_help_write(&help, &sink, "even") == 65
+        && strcmp(big, evens) == 0, "help: many lines filtered");
+  micro_flag_help_free(&help);
+  micro_flag_free(&set);
+
+  const char *filter = "unset";
+  char *plain[] = { "prog", "-v", "--help" };
+  check(micro_flag_help_requested(3, plain, "--help", &filter)
+        && filter == NULL, "help: --help not found");
+  char *filtered[] = { "prog", "--help=out" };
+  check(micro_flag_help_requested(2, filtered, "--help", &filter)
+        && strcmp(filter, "out") == 0, "help: filter not found");
+  char *other[] = { "prog", "--helpful", "-h", "x" };
+  check(!micro_flag_help_requested(4, other, "--help", &filter)
+        && filter == NULL, "help: other flag taken for --help");
+}
+
+int main(void)
+{
+  test_cluster();
+  test_equals();
+  test_sink();
+  test_stream();
+#ifdef MICRO_FLAG_LINUX
+  test_proc();
+#endif
+  test_response();
+  test_config();
+  test_env();
+  test_string();
+#ifdef MICRO_FLAG_ATOMICS
+  test_atomic();
+#endif
+  test_lazy();
+  test_cache();
+  test_help();
+
+  remove(TEST_CONF);
+  remove(TEST_RSP_A);
+  remove(TEST_RSP_B);
+  remove(TEST_CACHE);
+  printf("parse: %d cases, %d failures\n", cases, failures);
+  return failures == 0 ? 0 : 1;
+}
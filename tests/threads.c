@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: MIT
+//
+// Many threads parse with micro_flag_parse_r through one shared
+// MicroFlagSet, each into its own struct of an offset table, then
+// batches are parsed by a MicroFlagPool, then readers read snapshots
+// of a MicroFlagReload while it reloads. Build it with
+// -fsanitize=thread, as make test does, to check that the set is
+// only read, that the pool hands each item to one thread, and that
+// snapshots are only freed once no reader holds them:
+//
+//   make test
+//   ./tests/threads
+
+#define MICRO_FLAG_THREADS
+#define MICRO_FLAG_IMPLEMENTATION
+#include "micro-flag.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define NUM_PARSES  2000
+#define BATCH_SIZE  20000
+#define NUM_RELOADS 2000
+
+typedef struct {
+  bool verbose;
+  char a_char;
+  int a_number;
+  double a_double;
+  char *out_name;
+} Args;
+
+static const MicroFlag flags[] =
+  {
+    { MICRO_FLAG_BOOL,   MICRO_FLAG_OFFSET(Args, verbose),  "-v",
+                         "--verbose", "print more" },
+    { MICRO_FLAG_CHAR,   MICRO_FLAG_OFFSET(Args, a_char),   "-c",
+                         "--char",    "give me a char!" },
+    { MICRO_FLAG_INT,    MICRO_FLAG_OFFSET(Args, a_number), "-n",
+                         "--number",  "print this number" },
+    { MICRO_FLAG_DOUBLE, MICRO_FLAG_OFFSET(Args, a_double), "-d",
+                         "--double",  "print a double" },
+    { MICRO_FLAG_STR,    MICRO_FLAG_OFFSET(Args, out_name), "-o",
+                         "--output",  "set output file" },
+  };
+
+static MicroFlagSet set;
+
+typedef struct {
+  pthread_t thread;
+  int id;
+  int failures;
+} Worker;
+
+static void *worker_run(void *data)
+{
+  Worker *w = (Worker*) data;
+  char number[16], value[32], out[32], name[2] = { (char) ('a' + w->id), '\0' };
+  for (int i = 0; i < NUM_PARSES; ++i)
+  {
+    snprintf(number, sizeof(number), "%d", w->id * NUM_PARSES + i);
+    snprintf(value, sizeof(value), "%d.5", i);
+    snprintf(out, sizeof(out), "--out=file%d", w->id);
+    // Short flags are clustered and long ones abbreviated, to go
+    // through every lookup of the set
+    char *argv[] = { "threads", "-vc", name, "--num", number,
+                     "--double", value, out };
+    int argc = sizeof(argv) / sizeof(argv[0]);
+
+    Args args;
+    memset(&args, 0, sizeof(args));
+    MicroFlagContext ctx;
+    micro_flag_context_init(&ctx, &args);
+    char expected[32];
+    snprintf(expected, sizeof(expected), "file%d", w->id);
+    if (micro_flag_parse_r(&set, &ctx, argc, argv) != MICRO_FLAG_OK
+        || !args.verbose || args.a_char != name[0]
+        || args.a_number != w->id * NUM_PARSES + i
+        || args.a_double != i + 0.5
+        || strcmp(args.out_name, expected) != 0)
+      w->failures++;
+  }
+  return NULL;
+}
+
+// Parse batches of [BATCH_SIZE] vectors with [pool], some of which
+// fail, and check every item and the error returned
+//
+// Returns: the number of failures
+static int test_batches(MicroFlagPool *pool)
+{
+  char (*numbers)[16] = malloc(BATCH_SIZE * sizeof(*numbers));
+  char *(*vectors)[3] = malloc(BATCH_SIZE * sizeof(*vectors));
+  char ***argvs = malloc(BATCH_SIZE * sizeof(char**));
+  int *argcs = malloc(BATCH_SIZE * sizeof(int));
+  Args *args = malloc(BATCH_SIZE * sizeof(Args));
+  MicroFlagDiagnostic *results = malloc(BATCH_SIZE * sizeof(MicroFlagDiagnostic));
+  int failures = 0;
+  if (!numbers || !vectors || !argvs || !argcs || !args || !results)
+    failures++;
+
+  for (int round = 0; failures == 0 && round < 4; ++round)
+  {
+    // Round r fails at items 7000 + r and 15000
+    size_t bad = 7000 + (size_t) round;
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+      snprintf(numbers[i], sizeof(numbers[i]), "%d", (int) i * (round + 1));
+      vectors[i][0] = "threads";
+      vectors[i][1] = (i == bad || i == 15000) ? "--bad" : "-n";
+      vectors[i][2] = numbers[i];
+      argvs[i] = vectors[i];
+      argcs[i] = 3;
+    }
+    memset(args, 0, BATCH_SIZE * sizeof(Args));
+    MicroFlagError err = micro_flag_parse_batch_pool(pool, &set, argvs, argcs,
+                                                     BATCH_SIZE, args,
+                                                     sizeof(Args), results);
+    if (err != MICRO_FLAG_ERROR_UNKNOWN_FLAG)
+      failures++;
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+      bool is_bad = i == bad || i == 15000;
+      if ((results[i].error != MICRO_FLAG_OK) != is_bad
+          || (!is_bad && args[i].a_number != (int) i * (round + 1)))
+        failures++;
+    }
+  }
+
+  if (micro_flag_parse_batch_pool(pool, &set, argvs, argcs, BATCH_SIZE,
+                                  NULL, sizeof(Args), results)
+      != MICRO_FLAG_ERROR_NO_BASE)
+    failures++;
+
+  free(results);
+  free(args);
+  free(argcs);
+  free(argvs);
+  free(vectors);
+  free(numbers);
+  return failures;
+}
+
+// The generation of the snapshots loaded, and whether to fail
+typedef struct {
+  int generation;
+  bool fail;
+} LoadState;
+
+// Load a snapshot whose number and double are both the generation
+static MicroFlagError load_generation(const MicroFlagSet *load_set,
+                                      MicroFlagContext *ctx,
+                                      void *data)
+{
+  LoadState *state = (LoadState*) data;
+  char number[16], value[32];
+  snprintf(number, sizeof(number), "%d", state->generation);
+  snprintf(value, sizeof(value), "%d.0", state->fail ? -1 : state->generation);
+  char *argv[] = { "threads", "-n", number, "-d", value,
+                   state->fail ? "--bad" : "-v" };
+  return micro_flag_parse_r(load_set, ctx, 6, argv);
+}
+
+typedef struct {
+  pthread_t thread;
+  MicroFlagReload *reload;
+  bool *done;
+  int failures;
+} Reader;
+
+// Read snapshots until told to stop: each must be whole, and not
+// older than the one read before
+static void *reader_run(void *data)
+{
+  Reader *r = (Reader*) data;
+  MicroFlagReader reader;
+  micro_flag_reader_register(r->reload, &reader);
+  int last = 0;
+  while (!__atomic_load_n(r->done, __ATOMIC_ACQUIRE))
+  {
+    const Args *args = (const Args*) micro_flag_read_begin(r->reload, &reader);
+    if (!args->verbose || args->a_double != args->a_number
+        || args->a_number < last)
+      r->failures++;
+    last = args->a_number;
+    micro_flag_read_end(&reader);
+  }
+  micro_flag_reader_unregister(r->reload, &reader);
+  return NULL;
+}
+
+// Reload [NUM_RELOADS] times, failing now and then, while readers
+// read
+//
+// Returns: the number of failures
+static int test_reload(void)
+{
+  int failures = 0;
+  MicroFlagReload reload;
+  LoadState state = { 0, true };
+  if (micro_flag_reload_init(&reload, &set, NULL, sizeof(Args),
+                             load_generation, &state, NULL)
+      != MICRO_FLAG_ERROR_UNKNOWN_FLAG)
+    failures++;
+  micro_flag_reload_free(&reload);
+
+  state.fail = false;
+  if (micro_flag_reload_init(&reload, &set, NULL, sizeof(Args),
+                             load_generation, &state, NULL) != MICRO_FLAG_OK)
+    return failures + 1;
+
+  bool done = false;
+  Reader readers[NUM_THREADS];
+  int started = 0;
+  for (; started < NUM_THREADS; ++started)
+  {
+    readers[started].reload = &reload;
+    readers[started].done = &done;
+    readers[started].failures = 0;
+    if (pthread_create(&readers[started].thread, NULL, reader_run,
+                       &readers[started]) != 0)
+    {
+      failures++;
+      break;
+    }
+  }
+
+  // A failed reload keeps the last snapshot published
+  for (int i = 1; i <= NUM_RELOADS; ++i)
+  {
+    state.generation = i;
+    state.fail = i % 100 == 0;
+    if ((micro_flag_reload(&reload, NULL) == MICRO_FLAG_OK) == state.fail)
+      failures++;
+  }
+  __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+
+  for (int i = 0; i < started; ++i)
+  {
+    pthread_join(readers[i].thread, NULL);
+    failures += readers[i].failures;
+  }
+
+  MicroFlagReader reader;
+  micro_flag_reader_register(&reload, &reader);
+  const Args *args = (const Args*) micro_flag_read_begin(&reload, &reader);
+  if (args->a_number != NUM_RELOADS - 1)
+    failures++;
+  micro_flag_read_end(&reader);
+  micro_flag_reader_unregister(&reload, &reader);
+  micro_flag_reload_free(&reload);
+  return failures;
+}
+
+int main(void)
+{
+  if (micro_flag_compile(&set, flags, sizeof(flags) / sizeof(flags[0]))
+      != MICRO_FLAG_OK
+      || micro_flag_compile_trie(&set) != MICRO_FLAG_OK)
+    return 1;
+
+  Worker workers[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; ++i)
+  {
+    workers[i].id = i;
+    workers[i].failures = 0;
+    if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0)
+      return 1;
+  }
+  int failures = 0;
+  for (int i = 0; i < NUM_THREADS; ++i)
+  {
+    pthread_join(workers[i].thread, NULL);
+    failures += workers[i].failures;
+  }
+
+  MicroFlagPool pool;
+  if (micro_flag_pool_init(&pool, 4) != MICRO_FLAG_OK)
+    return 1;
+  failures += test_batches(&pool);
+  micro_flag_pool_free(&pool);
+  failures += test_reload();
+  micro_flag_free(&set);
+
+  printf("threads: %d threads, %d parses each, 4 pooled batches of %d, "
+         "%d reloads, %d failures\n", NUM_THREADS, NUM_PARSES, BATCH_SIZE,
+         NUM_RELOADS, failures);
+  return failures == 0 ? 0 : 1;
+}